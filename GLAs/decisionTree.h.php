@@ -92,6 +92,14 @@ function Decision_Tree(array $t_args, array $inputs, array $outputs)
     $cardinality = function($input) { return $input->get('cardinality'); };
     $domains = array_map($cardinality, array_get_index($inputs, 0)->get('inputs'));
 
+    // The samples are buffered into blocks of this many samples, which are then
+    // routed through the tree together.
+    $blockSize = get_default($t_args, 'block.size', 1024);
+    grokit_assert(is_int($blockSize) && $blockSize > 0,
+                  'Decision Tree: block.size must be a positive integer.');
+    $numDiscrete = count($domains);
+    $numContinuous = array_get_index($inputs, 1)->get('size');
+
     $sys_headers = ['armadillo', 'limits'];
     $user_headers = [];
     $lib_headers = ['regressiontree.h', 'binaryregressiontree.h',
@@ -114,11 +122,26 @@ class <?=$className?> {
 	// Type returned by MakeVector on continuous variables
 	using cvec = <?=array_get_index($inputs, 1)?>;
 
+	using size_type = <?=$constantState?>::size_type;
+
 	tree_type tree;
 
+	// The number of samples in a block.
+	static const constexpr size_type kBlockSize = <?=$blockSize?>;
+
+	// The buffered samples, one column per sample.
+	arma::imat d_block;
+	arma::mat c_block;
+
+	// The number of samples currently buffered.
+	size_type filled;
+
  public:
 	<?=$className?>(const <?=$constantState?>& const_state)
-      : tree(const_state.tree) {
+      : tree(const_state.tree),
+        d_block(<?=$numDiscrete?>, kBlockSize),
+        c_block(<?=$numContinuous?>, kBlockSize),
+        filled(0) {
 		// GLA States are constructed during a new round, so
 		// let the tree know about the new round.
 		tree.StartLearningRound();
@@ -126,14 +149,22 @@ class <?=$className?> {
 
   // Response variable is appended to the continuous predictors.
 	void AddItem(<?=const_typed_ref_args($inputs)?>) {
-		tree.LearnSample(<?=array_keys($inputs)[0]?>, <?=array_keys($inputs)[1]?>);
+		for (size_type i = 0; i < <?=$numDiscrete?>; i++)
+			d_block(i, filled) = <?=array_keys($inputs)[0]?>[i];
+		for (size_type i = 0; i < <?=$numContinuous?>; i++)
+			c_block(i, filled) = <?=array_keys($inputs)[1]?>[i];
+		if (++filled == kBlockSize)
+			Flush();
 	}
 
-	void AddState(const <?=$className?>& other) {
+	void AddState(<?=$className?>& other) {
+		Flush();
+		other.Flush();
 		tree.Merge(other.tree);
 	}
 
 	bool ShouldIterate(<?=$constantState?>& state) {
+		Flush();
 		// StopLearningRound returns true if the tree is done learning.
     bool should_iterate = tree.StopLearningRound();
     state.tree = tree;
@@ -150,6 +181,21 @@ class <?=$className?> {
     Json::Value temp = tree.ToJson();
 		<?=array_keys($outputs)[0]?>.set(temp);
 	}
+
+	// Used by Decision_Tree_Predict to compile the trained tree.
+	const tree_type& GetTree() const {
+		return tree;
+	}
+
+ private:
+	// Learns the buffered samples.
+	void Flush() {
+		if (filled == kBlockSize)
+			tree.LearnBlock(d_block, c_block);
+		else if (filled > 0)
+			tree.LearnBlock(d_block.head_cols(filled), c_block.head_cols(filled));
+		filled = 0;
+	}
 };
 
 <?  return [
@@ -164,5 +210,7 @@ class <?=$className?> {
         'output'          => $outputs,
         'generated_state' => $constantState,
         'result_type'     => 'single',
+        'extra'           => ['discrete'   => $numDiscrete,
+                              'continuous' => $numContinuous],
     ];
 } ?>
@@ -8,6 +8,8 @@ function GLM_Constant_State(array $t_args)
     $className               = $t_args['className'];
     $numberCoefficients      = $t_args['numberCoefficients'];
     $initialCoefficientsCode = $t_args['initialCoefficientsCode'];
+    $numberLambdas           = get_default($t_args, 'numberLambdas', 0);
+    $lambdaCode              = get_default($t_args, 'lambdaCode', '');
 ?>
 
 using namespace arma;
@@ -20,13 +22,26 @@ class <?=$className?>ConstantState {
   // Vector of coefficients which are to be predicted. The first element is the
   // intercept if there is one.
   vec::fixed<<?=$numberCoefficients?>> beta;
+<?  if ($numberLambdas > 0) { ?>
+
+  // The sequence of penalties, in decreasing order, and the coefficients fit for
+  // each of them, one per column. The last column is the same as beta.
+  vec::fixed<<?=$numberLambdas?>> lambdas;
+  mat::fixed<<?=$numberCoefficients?>, <?=$numberLambdas?>> path;
+<?  } ?>
 
  public:
   friend class <?=$className?>;
 
   <?=$className?>ConstantState()
       : iteration(0),
+<?  if ($numberLambdas > 0) { ?>
+        beta(<?=$initialCoefficientsCode?>),
+        lambdas(<?=$lambdaCode?>),
+        path(fill::zeros) {
+<?  } else { ?>
         beta(<?=$initialCoefficientsCode?>) {
+<?  } ?>
   }
 };
 <?
@@ -77,6 +92,54 @@ function GLM(array $t_args, array $inputs, array $outputs)
     // TODO: Make sure the warning happens.
     $maxIteration   = $t_args['maxit'];
 
+    // The number of items whose rows are buffered before being added to XWX at
+    // once. If positive, the linear predictors of the buffered rows are found
+    // with a single matrix-vector product and the family functions are applied
+    // to them as arrays. The rows are then scaled by the square root of their
+    // weight and added with a single symmetric rank-k update to the upper
+    // triangle of XWX, which is only mirrored in ShouldIterate. Otherwise, a
+    // full rank-1 update is performed per item.
+    $blockSize = get_default($t_args, 'block.size', 0);
+    $blocked = $blockSize > 0;
+
+    // The elastic net penalty. If either lambda or nlambda is given, each IRLS
+    // step minimizes the quadratic approximation of the log-likelihood plus
+    // lambda * (alpha * |b|_1 + (1 - alpha) / 2 * |b|_2^2) by coordinate descent
+    // over XWX and XWZ, for every lambda in a decreasing sequence. The intercept
+    // is not penalized and the predictors are not standardized. Either lambda is
+    // the sequence itself or nlambda values are spaced evenly on the log scale
+    // from the smallest penalty that zeroes every coefficient down to that
+    // times lambda.min.ratio. The IRLS weights are those of the smallest
+    // penalty, whose coefficients are reported as the fit; the rest of the path
+    // is exact for the gaussian family and a one-step approximation otherwise.
+    $penalized = array_key_exists('lambda', $t_args)
+              || array_key_exists('nlambda', $t_args);
+    if ($penalized) {
+        $alpha = get_default($t_args, 'alpha', 1);
+        grokit_assert(0 <= $alpha && $alpha <= 1,
+                      "alpha must be between 0 and 1.");
+        $lambdas = get_default($t_args, 'lambda', []);
+        if (!is_array($lambdas))
+            $lambdas = [$lambdas];
+        rsort($lambdas);
+        $lambdaGiven = count($lambdas) > 0;
+        $numberLambdas = $lambdaGiven
+            ? count($lambdas)
+            : get_default($t_args, 'nlambda', 100);
+        grokit_assert($numberLambdas > 0, "nlambda must be positive.");
+        $lambdaMinRatio = get_default($t_args, 'lambda.min.ratio', 1e-4);
+        // The coordinate descent ends when no coefficient changes the objective
+        // by more than this, or after this many sweeps.
+        $cdEpsilon = get_default($t_args, 'cd.epsilon', 1e-7);
+        $cdMaxIteration = get_default($t_args, 'cd.maxit', 1000);
+        $lambdaCode = $lambdaGiven
+            ? '{' . implode(', ', $lambdas) . '}'
+            : 'fill::zeros';
+    } else {
+        $numberLambdas = 0;
+        $lambdaCode = '';
+    }
+
     // Variables for use in PHP only
     $debug      = $t_args['debug'];
     $order      = $t_args['order'];
@@ -131,15 +194,59 @@ function GLM(array $t_args, array $inputs, array $outputs)
         if(sizeof($terms[$counter][0]) == 0)
             $interceptNeeded = false;
 
+    // Whether the rows are stored sparsely. Each term contributes exactly one
+    // non-zero element to a row, so a row with factors has only as many non-zero
+    // elements as there are terms, regardless of the cardinalities. Only the
+    // elements of XWX and XWZ at those positions are then updated. This is used
+    // by default when there are factors, unless the rows are buffered.
+    $hasFactors = false;
+    foreach ($terms as $term)
+        $hasFactors = $hasFactors || count($term[1]) > 0;
+    $sparse = get_default($t_args, 'sparse', $hasFactors && !$blocked);
+    grokit_assert(!($sparse && $blocked),
+                  "Sparse rows cannot be buffered.");
+
     // This finishes processing the models.
-    $inputVector = writeInputVector($terms, $interceptNeeded);
+    $inputVector = $sparse
+        ? writeSparseInputVector($terms, $interceptNeeded)
+        : writeInputVector($terms, $interceptNeeded);
 
     // The number of coefficients to predict.
     $numberCoefficients = $inputVector[0];
 
-    // To individually set the Armadillo vector elements.
+    // To individually set the Armadillo vector elements, or the positions and
+    // values of the non-zero elements for sparse rows.
     $setterCode = $inputVector[1];
 
+    // The number of non-zero elements in each sparse row.
+    $numberNonZero = $sparse ? $inputVector[2] : $numberCoefficients;
+
+    // The C++ code for the product of the current row and the coefficients.
+    $linearPredictor = $sparse
+        ? 'SparseDot(constant_state.beta)'
+        : 'dot(x, constant_state.beta)';
+
+    // Whether the first iteration also approximately fits the model. Rather than
+    // linearizing every item at the starting values, each state fits its own
+    // coefficients as it goes: after warm.block items, and again each time the
+    // number of items doubles, the state solves the XWX and XWZ accumulated so
+    // far and linearizes the following items at the result. Each solve is
+    // O(p^3), so doubling keeps the number of solves logarithmic in the number
+    // of items, regardless of p. The sums are merged as usual, so the first
+    // solve in ShouldIterate yields a pooled estimate that is close to the
+    // solution, and the remaining iterations are exact IRLS starting from it.
+    $warmStart = get_default($t_args, 'warm.start', false);
+    if ($warmStart) {
+        grokit_assert($missingStart,
+                      "A warm start cannot be combined with given coefficients.");
+        grokit_assert(!$blocked, "A warm start cannot be combined with block.size.");
+        grokit_assert(!$isGuassian,
+                      "The gaussian family needs no warm start.");
+        $warmBlock = get_default($t_args, 'warm.block', 1000);
+        grokit_assert($warmBlock > 0, "warm.block must be positive.");
+        $warmPredictor = $sparse ? 'SparseDot(warm_beta)' : 'dot(x, warm_beta)';
+    }
+
     // Construction of C++ code to assign the initial coefficients if they were
     // specified. Otherwise an empty string will be produced.
     $initialCoefficientsCode = $missingStart
@@ -155,7 +262,9 @@ class <?=$className?>;
         "statistics::GLM_Constant_State",
         ['className'               => $className,
          'numberCoefficients'      => $numberCoefficients,
-         'initialCoefficientsCode' => $initialCoefficientsCode,]
+         'initialCoefficientsCode' => $initialCoefficientsCode,
+         'numberLambdas'           => $numberLambdas,
+         'lambdaCode'              => $lambdaCode,]
     );
 ?>
 
@@ -174,6 +283,35 @@ class <?=$className?> {
   // The other matrix used to compute the next iteration of the coefficients.
   // It is equal to XWZ, where Z is the matrix of working dependent variables.
   vec::fixed<<?=$numberCoefficients?>> XWZ;
+<?  if ($blocked) { ?>
+
+  // The buffered rows, one per column. When the panel is flushed, each is
+  // multiplied by the square root of its weight so that XWX is the sum of the
+  // outer products of the columns.
+  mat panel;
+
+  // The number of rows currently in the panel.
+  uword panel_count;
+
+  // The responses and prior weights of the buffered rows.
+  vec responses, priors;
+
+  // The linear predictors and predicted means of the buffered rows. Before the
+  // panel is flushed, the linear predictors only hold the offsets, except in
+  // the first iteration, when both are set from the starting values.
+  vec etas, mus;
+
+  // The derivatives of the link, the variances and the deviances at the means.
+  vec derivatives, variances, deviances;
+<?  } ?>
+<?  if ($warmStart) { ?>
+
+  // The coefficients fit by this state during the first iteration.
+  vec::fixed<<?=$numberCoefficients?>> warm_beta;
+
+  // The number of items after which warm_beta is next fit.
+  long warm_count;
+<?  } ?>
 
   // The total numbers of items processed so far.
   long count;
@@ -189,9 +327,16 @@ class <?=$className?> {
   // They are member variables rather than local variables in order to avoid
   // repeatedly allocating the same memory for them.
 
+<?  if ($sparse) { ?>
+  // The positions of the non-zero elements of the current row, in increasing
+  // order, and their values. They are set at the beginning of the AddItem call.
+  uword indices[<?=$numberNonZero?>];
+  double values[<?=$numberNonZero?>];
+<?  } else { ?>
   // A vector that contains the current data and whose elements are individually
   // set at the beginning of the AddItem call.
   vec::fixed<<?=$numberCoefficients?>> x;
+<?  } ?>
 
   // The response of the model. It is either a simple variable matching
   // a parameter of AddItem or an expression containing multiple parameters.
@@ -218,25 +363,70 @@ class <?=$className?> {
  public:
   <?=$className?>(const <?=$constantState?>& state)
       : constant_state(state),
+        XWX(zeros<mat>(<?=$numberCoefficients?>, <?=$numberCoefficients?>)),
+        XWZ(zeros<vec>(<?=$numberCoefficients?>)),
+<?  if ($blocked) { ?>
+        panel(<?=$numberCoefficients?>, <?=$blockSize?>),
+        panel_count(0),
+        responses(<?=$blockSize?>),
+        priors(<?=$blockSize?>),
+        etas(<?=$blockSize?>),
+        mus(<?=$blockSize?>),
+        derivatives(<?=$blockSize?>),
+        variances(<?=$blockSize?>),
+        deviances(<?=$blockSize?>),
+<?  } ?>
+<?  if ($warmStart) { ?>
+        warm_beta(fill::zeros),
+        warm_count(<?=$warmBlock?>),
+<?  } ?>
         count(0),
-        x(),
         deviance(0),
-        pearson(0),
-        XWX(zeros<mat>(<?=$numberCoefficients?>, <?=$numberCoefficients?>)),
-        XWZ(zeros<vec>(<?=$numberCoefficients?>)) {
+        pearson(0) {
   }
 
   void AddItem(<?=const_typed_ref_args($inputs)?>) {
     // Processing of data
     ++count;
+<?  if (!$sparse) { ?>
     x.fill(0.0);
+<?  } ?>
     <?=$setterCode, PHP_EOL?>
     y = <?=$response?>;
+<?  if ($blocked) { ?>
+
+    // The row is buffered and the rest of the work is done for the whole panel.
+    panel.col(panel_count) = x;
+    responses[panel_count] = y;
+    priors[panel_count] = <?=$weights?>;
+    etas[panel_count] = 0<?=$offset?>;
+<?      if ($missingStart) { ?>
+    if (constant_state.iteration == 0) {
+<?          if ($missingEta) { ?>
+      mu  = <?=$initialMu?>;
+      eta = <?=$initialEta?>;
+<?          } else { ?>
+      eta = <?=$initialEta?>;
+      mu  = <?=$initialMu?>;
+<?          } ?>
+      etas[panel_count] = eta;
+      mus[panel_count] = mu;
+    }
+<?      } ?>
+    if (++panel_count == <?=$blockSize?>)
+      FlushPanel();
+<?      if ($debug) { ?>
+
+    // Debug statements
+    if (count <= 10)
+      cout << "x: " << endl << x << endl << "y: " << y << endl;
+<?      } ?>
+<?  } else { ?>
 
     // Rank-1 updates
 <?  if ($missingStart) { ?>
     // Initial values will be found by IBM's algorithm.
-    if (constant_state.iteration == 0) {
+    if (constant_state.iteration == 0<?=$warmStart ? " && count <= $warmBlock" : ''?>) {
 <?      if ($missingEta) { ?>
       // Eta is built off mu.
       mu  = <?=$initialMu?>;
@@ -245,21 +435,44 @@ class <?=$className?> {
       // Mu is built off eta.
       eta = <?=$initialEta?>;
       mu  = <?=$initialMu?>;
+<?      } ?>
+<?      if ($warmStart) { ?>
+    } else if (constant_state.iteration == 0) {
+      // Later items are linearized at the coefficients fit by this state.
+      eta = <?=$warmPredictor?><?=$offset?>;
+      mu = <?=$linkInverse?>(eta);
 <?      } ?>
     } else {
-      eta = dot(x, constant_state.beta)<?=$offset?>;
+      eta = <?=$linearPredictor?><?=$offset?>;
       mu = <?=$linkInverse?>(eta);
     }
 <?  } else { ?>
-    eta = dot(x, constant_state.beta)<?=$offset?>;
+    eta = <?=$linearPredictor?><?=$offset?>;
     mu = <?=$linkInverse?>(eta);
 <?  } ?>
     z = eta + (y - mu) * <?=$linkDerivative?>(mu);
     w = <?=$weights?>
       / (<?=$variance?>(mu) * std::pow(<?=$linkDerivative?>(mu), 2));
 
+<?  if ($sparse) { ?>
+    // Only the upper triangle of XWX is updated, as the indices are increasing.
+    for (uword first = 0; first < <?=$numberNonZero?>; first++) {
+      double scaled = w * values[first];
+      XWZ[indices[first]] += scaled * z;
+      for (uword second = first; second < <?=$numberNonZero?>; second++)
+        XWX(indices[first], indices[second]) += scaled * values[second];
+    }
+<?  } else { ?>
     XWZ += x * w     * z;  // Update of XWZ
     XWX += x * x.t() * w;  // Update of XWX
+<?  } ?>
+<?  if ($warmStart) { ?>
+
+    if (constant_state.iteration == 0 && count >= warm_count) {
+      FitWarm();
+      warm_count = 2 * count;
+    }
+<?  } ?>
 
     deviance += <?=$weights?> * <?=$deviance?>(y, mu);
     pearson += <?=$weights?> * (y - mu) * (y - mu) / <?=$variance?>(mu);
@@ -267,7 +480,12 @@ class <?=$className?> {
 <?  if ($debug) { ?>
     // Debug statements
     if (count <= 10){
+<?      if ($sparse) { ?>
+      for (uword counter = 0; counter < <?=$numberNonZero?>; counter++)
+        cout << "x[" << indices[counter] << "]: " << values[counter] << endl;
+<?      } else { ?>
       cout << "x: " << endl << x << endl;
+<?      } ?>
       cout << "y: " << y << " eta: " << eta << " mu: " << mu
            << " z: " << z << " w: " << w
            << " deivance: " << deviance
@@ -276,10 +494,92 @@ class <?=$className?> {
       cout << "XWX: " << endl << XWX << endl;
     };
 <?  } ?>
+<?  } ?>
+  }
+
+<?  if ($warmStart) { ?>
+  // Fits warm_beta to the sums accumulated so far. XWX is usually positive
+  // definite, so a Cholesky decomposition is tried first. If XWX is singular,
+  // e.g. because a factor level has not been seen yet, a small ridge is added.
+  // If that fails too, the previous coefficients are kept.
+  void FitWarm() {
+    mat A = symmatu(XWX);
+    vec beta;
+    bool solved = solve(beta, A, XWZ,
+                        solve_opts::likely_sympd + solve_opts::no_approx);
+    if (!solved) {
+      A.diag() += 1e-8 * (1 + trace(A) / <?=$numberCoefficients?>);
+      solved = solve(beta, A, XWZ,
+                     solve_opts::likely_sympd + solve_opts::no_approx);
+    }
+    if (solved)
+      warm_beta = beta;
+  }
+
+<?  } ?>
+<?  if ($sparse) { ?>
+  // The product of the current row and the coefficients.
+  double SparseDot(const vec& beta) const {
+    double result = 0;
+    for (uword counter = 0; counter < <?=$numberNonZero?>; counter++)
+      result += values[counter] * beta[indices[counter]];
+    return result;
+  }
+
+<?  } ?>
+<?  if ($blocked) { ?>
+  // Processes the buffered rows at once. The linear predictors are computed by
+  // a single matrix-vector product and the family functions are applied to
+  // whole arrays using their vectorized versions. The outer products of the
+  // rows are then added to the upper triangle of XWX with a single call to
+  // BLAS. The lower triangle is left untouched.
+  void FlushPanel() {
+    if (panel_count == 0)
+      return;
+    const uword size = panel_count;
+<?      if ($missingStart) { ?>
+    if (constant_state.iteration > 0) {
+      etas.head(size) += panel.cols(0, size - 1).t() * constant_state.beta;
+      <?=$linkInverse?>(etas.memptr(), mus.memptr(), size);
+    }
+<?      } else { ?>
+    etas.head(size) += panel.cols(0, size - 1).t() * constant_state.beta;
+    <?=$linkInverse?>(etas.memptr(), mus.memptr(), size);
+<?      } ?>
+    <?=$linkDerivative?>(mus.memptr(), derivatives.memptr(), size);
+    <?=$variance?>(mus.memptr(), variances.memptr(), size);
+    <?=$deviance?>(responses.memptr(), mus.memptr(), deviances.memptr(), size);
+    // The linear predictors are replaced by w * z and the derivatives by the
+    // square roots of the weights, as neither is needed afterwards.
+    for (uword counter = 0; counter < size; counter++) {
+      double residual = responses[counter] - mus[counter];
+      z = etas[counter] + residual * derivatives[counter];
+      w = priors[counter]
+        / (variances[counter] * derivatives[counter] * derivatives[counter]);
+      deviance += priors[counter] * deviances[counter];
+      pearson += priors[counter] * residual * residual / variances[counter];
+      etas[counter] = w * z;
+      derivatives[counter] = std::sqrt(w);
+    }
+    XWZ += panel.cols(0, size - 1) * etas.head(size);
+    panel.cols(0, size - 1).each_row() %= derivatives.head(size).t();
+    const char uplo = 'U';
+    const char trans = 'N';
+    const blas_int n = <?=$numberCoefficients?>;
+    const blas_int k = panel_count;
+    const double one = 1;
+    blas::syrk(&uplo, &trans, &n, &k, &one, panel.memptr(), &n,
+               &one, XWX.memptr(), &n);
+    panel_count = 0;
   }
 
+<?  } ?>
   // Straightforward since all the state is numerically additive
-  void AddState (const <?=$className?>& other) {
+  void AddState (<?=$className?>& other) {
+<?  if ($blocked) { ?>
+    FlushPanel();
+    other.FlushPanel();
+<?  } ?>
 <?  if ($debug) { ?>
     // Debug statements
     cout << "Merging" << endl;
@@ -306,9 +606,21 @@ class <?=$className?> {
   // the right by XWZ, i.e. B = (XWX)^-1 * XWZ. This new set of coefficients is
   // then compared to the current set (beta) and checked for convergence.
   bool ShouldIterate(<?=$constantState?>& modible_state) {
+<?  if ($blocked) { ?>
+    // The final state may never have been merged, so its panel is emptied here.
+    FlushPanel();
+<?  } ?>
+<?  if ($blocked || $sparse) { ?>
+    XWX = symmatu(XWX);
+<?  } ?>
 <?  if ($isGuassian) { ?>
     modible_state.iteration++;
+<?      if ($penalized) { ?>
+    FitPath(modible_state);
+    modible_state.beta = modible_state.path.col(<?=$numberLambdas - 1?>);
+<?      } else { ?>
     modible_state.beta = pinv(XWX, <?=$epsilon?>) * XWZ;
+<?      } ?>
     return modible_state.iteration < 2;
 <?  } else {
         if ($debug) { ?>
@@ -323,7 +635,12 @@ class <?=$className?> {
     // and XWZ matrices are 0 because they aren't updated in the final run.
     // Computation of the new coefficients.
     <? /*Old version: vec new_beta = pinv(XWX, <?=$epsilon?>) * XWZ;*/?>
+<?      if ($penalized) { ?>
+    FitPath(modible_state);
+    vec new_beta = modible_state.path.col(<?=$numberLambdas - 1?>);
+<?      } else { ?>
     vec new_beta = solve(XWX, XWZ);
+<?      } ?>
     // TODO: Check that R uses this branch
     bool has_converged = modible_state.iteration == 1
       ? false
@@ -340,15 +657,110 @@ class <?=$className?> {
   }
 
   bool HasConverged(vec old_beta, vec new_beta) {
+<?  if ($penalized) { ?>
+    // Coefficients that were zeroed by the penalty must remain zero, as the
+    // relative change is undefined for them.
+    uvec zero = find(old_beta == 0);
+    if (any(new_beta.elem(zero) != 0))
+      return false;
+    uvec nonzero = find(old_beta != 0);
+    return nonzero.is_empty()
+        || max(abs((old_beta.elem(nonzero) - new_beta.elem(nonzero))
+                   / old_beta.elem(nonzero))) < <?=$epsilon?>;
+<?  } else { ?>
     return max(abs((old_beta - new_beta) / old_beta)) < <?=$epsilon?>;
+<?  } ?>
+  }
+<?  if ($penalized) { ?>
+
+  // Fits the coefficients for each penalty in turn. XWX and XWZ are scaled by
+  // the number of items so that the penalty does not depend on the size of the
+  // data. In the first fit, each penalty starts from the coefficients of the
+  // previous, larger one; afterwards, each starts from its own previous fit.
+  void FitPath(<?=$constantState?>& state) {
+    mat A = XWX / count;
+    vec b = XWZ / count;
+<?      if (!$lambdaGiven) { ?>
+    if (state.iteration == 1) {
+      // The smallest penalty for which only the intercept is non-zero.
+      vec gradient = b;
+<?          if ($interceptNeeded) { ?>
+      if (A(0, 0) > 0)
+        gradient -= A.col(0) * (b[0] / A(0, 0));
+      gradient[0] = 0;
+<?          } ?>
+      double lambda_max = max(abs(gradient)) / <?=max($alpha, 1e-3)?>;
+      state.lambdas = lambda_max * exp(linspace<vec>(
+          0, std::log(<?=$lambdaMinRatio?>), <?=$numberLambdas?>));
+    }
+<?      } ?>
+    vec beta(<?=$numberCoefficients?>, fill::zeros);
+    for (uword counter = 0; counter < <?=$numberLambdas?>; counter++) {
+      if (state.iteration > 1)
+        beta = state.path.col(counter);
+      CoordinateDescent(A, b, state.lambdas[counter], beta);
+      state.path.col(counter) = beta;
+    }
+  }
+
+  // Minimizes 1/2 * beta^T * A * beta - beta^T * b plus the elastic net penalty
+  // using covariance updates: the gradient b - A * beta is kept up to date using
+  // a single column of A whenever a coefficient changes.
+  void CoordinateDescent(const mat& A, const vec& b, double lambda, vec& beta) {
+    const double l1 = lambda * <?=$alpha?>;
+    const double l2 = lambda * <?=1 - $alpha?>;
+    vec gradient = b - A * beta;
+    for (int sweep = 0; sweep < <?=$cdMaxIteration?>; sweep++) {
+      double largest = 0;
+      for (uword j = 0; j < <?=$numberCoefficients?>; j++) {
+        double old = beta[j];
+        double partial = gradient[j] + A(j, j) * old;
+<?          if ($interceptNeeded) { ?>
+        if (j == 0) {
+          beta[j] = A(j, j) > 0 ? partial / A(j, j) : 0;
+        } else {
+          double denominator = A(j, j) + l2;
+          beta[j] = denominator > 0
+              ? SoftThreshold(partial, l1) / denominator
+              : 0;
+        }
+<?          } else { ?>
+        double denominator = A(j, j) + l2;
+        beta[j] = denominator > 0
+            ? SoftThreshold(partial, l1) / denominator
+            : 0;
+<?          } ?>
+        double change = beta[j] - old;
+        if (change != 0) {
+          gradient -= A.col(j) * change;
+          largest = std::max(largest, A(j, j) * change * change);
+        }
+      }
+      if (largest < <?=$cdEpsilon?>)
+        break;
+    }
   }
 
+  static double SoftThreshold(double value, double threshold) {
+    if (value > threshold)
+      return value - threshold;
+    if (value < -threshold)
+      return value + threshold;
+    return 0;
+  }
+<?  } ?>
+
   void GetResult(<?=typed_ref_args($outputs)?>) {
-<?= ProduceResult(array_keys($outputs)[0], [
-	'iteration' => 'constant_state.iteration',
-	'coefficients' => 'constant_state.beta',
-	'deviance' => 'deviance',
-	'pearson' => 'pearson' ]) ?>
+<?  $result = [
+        'iteration' => 'constant_state.iteration',
+        'coefficients' => 'constant_state.beta',
+        'deviance' => 'deviance',
+        'pearson' => 'pearson' ];
+    if ($penalized) {
+        $result['lambda'] = 'constant_state.lambdas';
+        $result['path'] = 'constant_state.path';
+    } ?>
+<?= ProduceResult(array_keys($outputs)[0], $result) ?>
 
 <?  if ($debug) { ?>
 	cout << <?=array_keys($outputs)[0]?>.get() << endl;
@@ -592,4 +1004,31 @@ function writeInputVector(array $terms, $interceptNeeded) {
     return array($offset, implode(PHP_EOL, $cppCode));
 }
 
+// The following creates the code to fill the sparse representation of the data
+// item. Each term contributes a single non-zero element, whose position is the
+// index of the corresponding element in writeInputVector and whose value is the
+// product of its numeric interactions. Because the terms occupy consecutive
+// ranges of the vector, the positions are strictly increasing. The return is an
+// array containing the size of the vector, the code to fill the positions and
+// values, and the number of non-zero elements.
+function writeSparseInputVector(array $terms, $interceptNeeded) {
+    $offset = (int) $interceptNeeded;  // the offset of the c++ vector
+    $nonZero = 0;  // the number of non-zero elements so far
+    $cppCode = array();  // lines of code to be printed in the c++ file
+    if ($interceptNeeded) {
+        $cppCode[] = 'indices[0] = 0;';
+        $cppCode[] = 'values[0] = 1;';
+        $nonZero ++;
+    }
+    for ($termCounter = 0; $termCounter < count($terms); $termCounter ++) {
+        $cppCode[] = "indices[$nonZero] = $offset"
+                   . Factors_To_Index($terms[$termCounter][1]) . ';';
+        $cppCode[] = "values[$nonZero] = "
+                   . Numeric_To_Value($terms[$termCounter][0]) . ';';
+        $offset += array_product($terms[$termCounter][1]);
+        $nonZero ++;
+    }
+    return array($offset, implode(PHP_EOL, $cppCode), $nonZero);
+}
+
 ?>
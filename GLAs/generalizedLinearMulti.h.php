@@ -0,0 +1,407 @@
+<?
+// This GLA fits several generalized linear models using the same passes over
+// the data. The models share the predictors but each has its own response,
+// family, link, weights and offset, and may also use only a subset of the
+// shared predictors. This is done via the following:
+// 1. The coefficients of every model are stored as the columns of one matrix.
+// 2. The row of the design matrix and its outer product are computed once per
+//    item rather than once per model.
+// 3. Each model updates its own XWX and XWZ using its own working weight and
+//    working dependent variable.
+// A model stops accumulating once it has converged, so that the later passes
+// only perform the work of the models that are still being fit.
+
+// Template Args:
+// predictors, order, intercept: The shared terms, as in GLM.
+// models:       A list of models. Each model is an array with the following:
+//   response:   Required. The response, as in GLM.
+//   family, link, weights, offset, mu.start, eta.start: As in GLM. The family
+//     and link default to those given for the GLA as a whole, if any.
+//   predictors: Optional. A subset of the shared predictors. The coefficients
+//     of the remaining terms are fixed at zero.
+// epsilon:      The maximum relative change in a coefficient for convergence.
+// maxit:        The maximum number of iterations.
+function GLM_Multi_Constant_State(array $t_args)
+{
+    // Grabbing variables from $t_args
+    $className          = $t_args['className'];
+    $numberCoefficients = $t_args['numberCoefficients'];
+    $numberModels       = $t_args['numberModels'];
+    $columns            = $t_args['columns'];
+?>
+
+using namespace arma;
+
+class <?=$className?>ConstantState {
+ private:
+  // Current iteration of the fitting.
+  long iteration;
+
+  // The coefficients of each model, one per column. The coefficients of terms
+  // that a model does not use are always zero.
+  mat::fixed<<?=$numberCoefficients?>, <?=$numberModels?>> betas;
+
+  // The positions of the coefficients that each model fits.
+  uvec columns[<?=$numberModels?>];
+
+  // Whether each model is still being fit.
+  urowvec::fixed<<?=$numberModels?>> active;
+
+  // The number of times the coefficients of each model have been computed.
+  urowvec::fixed<<?=$numberModels?>> iterations;
+
+  // The deviance and Pearson's chi squared statistic of each model, recorded
+  // during the last iteration in which it was active.
+  rowvec::fixed<<?=$numberModels?>> deviance;
+  rowvec::fixed<<?=$numberModels?>> pearson;
+
+ public:
+  friend class <?=$className?>;
+
+  <?=$className?>ConstantState()
+      : iteration(0),
+        betas(zeros<mat>(<?=$numberCoefficients?>, <?=$numberModels?>)),
+        active(ones<urowvec>(<?=$numberModels?>)),
+        iterations(zeros<urowvec>(<?=$numberModels?>)),
+        deviance(zeros<rowvec>(<?=$numberModels?>)),
+        pearson(zeros<rowvec>(<?=$numberModels?>)) {
+<?  foreach ($columns as $model => $positions) { ?>
+    columns[<?=$model?>] = {<?=implode(', ', $positions)?>};
+<?  } ?>
+  }
+};
+<?
+    return [
+        'kind' => 'RESOURCE',
+        'name' => $className . 'ConstantState',
+        'system_headers' => ['armadillo'],
+        'user_headers' => [],
+    ];
+}
+
+function GLM_Multi(array $t_args, array $inputs, array $outputs)
+{
+    // Setting output type
+    $outputs = ['_output' => lookupType('JSON')];
+
+    // Class name is randomly generated.
+    $className = generate_name("GLM_Multi");
+
+    // Processing of template arguments
+    $epsilon      = $t_args['epsilon'];
+    $maxIteration = $t_args['maxit'];
+    $debug        = get_default($t_args, 'debug', 0);
+    $order        = $t_args['order'];
+    $predictors   = $t_args['predictors'];
+    $models       = $t_args['models'];
+
+    grokit_assert(is_array($models) && count($models) > 0,
+                  "At least one model must be given.");
+    $numberModels = count($models);
+
+    // See GLM for the meaning of these.
+    $properLinks = [
+         'gaussian'        => array('identity'),
+         'poisson'         => array('identity', 'log',   'sqrt'),
+         'gamma'           => array('identity', 'log',   'inverse'),
+         'binomial'        => array('cloglog',  'logit', 'probit', 'cauchit'),
+         'inverseGaussian' => array('inverseSquared')
+    ];
+
+    // This constructs the PHP arrays necessary to process the shared terms.
+    $terms = Construct_Input_Terms($inputs, $predictors, $order);
+    Remove_Redundant_Keys($terms);
+
+    // Whether or not the models will contain an intercept.
+    $interceptNeeded = $t_args['intercept'];
+
+    // If any term contains only factors, then the intercept is not needed.
+    for($counter = 0; $counter < count($terms) && $interceptNeeded; $counter ++)
+        if(sizeof($terms[$counter][0]) == 0)
+            $interceptNeeded = false;
+
+    $inputVector = writeInputVector($terms, $interceptNeeded);
+
+    // The number of coefficients of each model, including unused ones.
+    $numberCoefficients = $inputVector[0];
+
+    // To individually set the Armadillo vector elements
+    $setterCode = $inputVector[1];
+
+    // The positions of the coefficients belonging to each shared term.
+    $termColumns = [];
+    $offset = (int) $interceptNeeded;
+    foreach ($terms as $term) {
+        $size = array_product($term[1]);
+        $termColumns[] = range($offset, $offset + $size - 1);
+        $offset += $size;
+    }
+
+    // The C++ code and PHP information for each model.
+    $modelInfo = [];
+    $columns = [];
+    foreach ($models as $model => $spec) {
+        grokit_assert(array_key_exists('response', $spec),
+                      "Model $model is missing a response.");
+        $response = "({$spec['response']})";
+        $family = strval(get_default($spec, 'family',
+                                     get_default($t_args, 'family', 'gaussian')));
+        $link   = strval(get_default($spec, 'link',
+                                     get_default($t_args, 'link', 'identity')));
+        grokit_assert(array_key_exists($family, $properLinks),
+                      "Improper family: $family");
+        grokit_assert(in_array($link, $properLinks[$family]),
+                      "Improper link function: $link");
+
+        $linkFunction   = "_$link";
+        $linkInverse    = "inverse$linkFunction";
+        $weights        = get_default($spec, 'weights', '1.0');
+        $offsetCode     = array_key_exists('offset', $spec)
+                        ? ' + ' . $spec['offset'] : '';
+
+        // Starting values are always found by IBM's algorithm.
+        if ($missingEta = !array_key_exists('eta.start', $spec)) {
+            $initialEta = "$linkFunction(mu)";
+            $initialMu  = array_key_exists('mu.start', $spec)
+                ? $spec['mu.start']
+                : ($family == "binomial"
+                    ? "($response * $weights + 0.5) / ($weights + 1)"
+                    : 'y');
+        } else {
+            $initialEta = $spec['eta.start'];
+            $initialMu  = "$linkInverse(eta)";
+        }
+
+        // The coefficients used by this model. A subset is matched against the
+        // shared terms after the redundant ones have been removed.
+        if (array_key_exists('predictors', $spec)) {
+            $positions = $interceptNeeded ? [0] : [];
+            foreach ($spec['predictors'] as $predictor) {
+                $term = Construct_Input_Terms(
+                    $inputs, [$predictor], [count(explode(':', $predictor))]
+                )[0];
+                $index = array_search($term, $terms);
+                grokit_assert($index !== false,
+                              "Model $model uses a predictor that is not shared: $predictor");
+                $positions = array_merge($positions, $termColumns[$index]);
+            }
+            sort($positions);
+            $columns[] = array_values(array_unique($positions));
+        } else {
+            $columns[] = range(0, $numberCoefficients - 1);
+        }
+
+        $modelInfo[] = [
+            'response'       => $response,
+            'responseName'   => $spec['response'],
+            'family'         => $family,
+            'link'           => $link,
+            'linkInverse'    => $linkInverse,
+            'linkDerivative' => "deriv$linkFunction",
+            'variance'       => "var_$family",
+            'deviance'       => "deviance_$family",
+            'weights'        => $weights,
+            'offset'         => $offsetCode,
+            'missingEta'     => $missingEta,
+            'initialEta'     => $initialEta,
+            'initialMu'      => $initialMu,
+        ];
+    }
+?>
+
+using namespace arma;
+
+class <?=$className?>;
+
+<?  $constantState = lookupResource(
+        "statistics::GLM_Multi_Constant_State",
+        ['className'          => $className,
+         'numberCoefficients' => $numberCoefficients,
+         'numberModels'       => $numberModels,
+         'columns'            => $columns,]
+    );
+?>
+
+class <?=$className?> {
+ private:
+  // The typical constant state for an iterable GLA.
+  const <?=$constantState?>& constant_state;
+
+  // The XWX matrix of each model, one per slice.
+  cube::fixed<<?=$numberCoefficients?>, <?=$numberCoefficients?>, <?=$numberModels?>> XWX;
+
+  // The XWZ vector of each model, one per column.
+  mat::fixed<<?=$numberCoefficients?>, <?=$numberModels?>> XWZ;
+
+  // The total numbers of items processed so far.
+  long count;
+
+  // The deviance and Pearson's chi squared statistic of each model recorded
+  // during the current iteration.
+  rowvec::fixed<<?=$numberModels?>> deviance;
+  rowvec::fixed<<?=$numberModels?>> pearson;
+
+  // The current row of the design matrix and its outer product, which are
+  // shared by every model.
+  vec::fixed<<?=$numberCoefficients?>> x;
+  mat::fixed<<?=$numberCoefficients?>, <?=$numberCoefficients?>> outer;
+
+  // The variables of the rank-1 updates for the current model. Their names are
+  // the same as in GLM.
+  double y, eta, mu, z, w;
+
+ public:
+  <?=$className?>(const <?=$constantState?>& state)
+      : constant_state(state),
+        XWX(fill::zeros),
+        XWZ(fill::zeros),
+        count(0),
+        deviance(fill::zeros),
+        pearson(fill::zeros) {
+  }
+
+  void AddItem(<?=const_typed_ref_args($inputs)?>) {
+    ++count;
+    x.fill(0.0);
+    <?=$setterCode, PHP_EOL?>
+    outer = x * x.t();
+<?  foreach ($modelInfo as $model => $info) { ?>
+
+    // Model <?=$model?>: <?=$info['family']?> with <?=$info['link']?> link.
+    if (constant_state.active[<?=$model?>]) {
+      y = <?=$info['response']?>;
+      if (constant_state.iteration == 0) {
+<?      if ($info['missingEta']) { ?>
+        mu  = <?=$info['initialMu']?>;
+        eta = <?=$info['initialEta']?>;
+<?      } else { ?>
+        eta = <?=$info['initialEta']?>;
+        mu  = <?=$info['initialMu']?>;
+<?      } ?>
+      } else {
+        eta = dot(x, constant_state.betas.col(<?=$model?>))<?=$info['offset']?>;
+        mu = <?=$info['linkInverse']?>(eta);
+      }
+      z = eta + (y - mu) * <?=$info['linkDerivative']?>(mu);
+      w = <?=$info['weights']?>
+
+        / (<?=$info['variance']?>(mu) * std::pow(<?=$info['linkDerivative']?>(mu), 2));
+      XWZ.col(<?=$model?>) += x * (w * z);
+      XWX.slice(<?=$model?>) += outer * w;
+      deviance[<?=$model?>] += <?=$info['weights']?> * <?=$info['deviance']?>(y, mu);
+      pearson[<?=$model?>] += <?=$info['weights']?> * (y - mu) * (y - mu)
+                              / <?=$info['variance']?>(mu);
+    }
+<?  } ?>
+  }
+
+  void AddState(const <?=$className?>& other) {
+    count    += other.count;
+    XWX      += other.XWX;
+    XWZ      += other.XWZ;
+    deviance += other.deviance;
+    pearson  += other.pearson;
+  }
+
+  // Each active model computes its next coefficients as in GLM, restricted to
+  // the coefficients that it uses. The iteration continues while any model is
+  // active.
+  bool ShouldIterate(<?=$constantState?>& modible_state) {
+    modible_state.iteration++;
+<?  if ($debug) { ?>
+    cout << "iteration: " << modible_state.iteration << endl;
+<?  } ?>
+<?  foreach ($modelInfo as $model => $info) { ?>
+    if (modible_state.active[<?=$model?>])
+      modible_state.active[<?=$model?>] = <?=$info['family'] == 'gaussian' ? 'UpdateGaussian' : 'Update'?>(modible_state, <?=$model?>);
+<?  } ?>
+    return    modible_state.iteration < <?=$maxIteration?>
+
+           && any(modible_state.active);
+  }
+
+  // Gaussian models are solved directly in the first iteration. They remain
+  // active for one more iteration to record the deviance of the fit.
+  bool UpdateGaussian(<?=$constantState?>& state, uword model) {
+    state.deviance[model] = deviance[model];
+    state.pearson[model] = pearson[model];
+    if (state.iteration > 1)
+      return false;
+    const uvec& columns = state.columns[model];
+    vec xwz = XWZ.col(model);
+    vec beta = state.betas.col(model);
+    beta.elem(columns)
+        = pinv(XWX.slice(model).submat(columns, columns), <?=$epsilon?>)
+        * xwz.elem(columns);
+    state.betas.col(model) = beta;
+    state.iterations[model]++;
+    return true;
+  }
+
+  // Returns whether the model has yet to converge.
+  bool Update(<?=$constantState?>& state, uword model) {
+    state.deviance[model] = deviance[model];
+    state.pearson[model] = pearson[model];
+    const uvec& columns = state.columns[model];
+    vec xwz = XWZ.col(model);
+    vec beta = state.betas.col(model);
+    vec new_beta = solve(XWX.slice(model).submat(columns, columns),
+                         xwz.elem(columns));
+    // The first computation only replaces the starting values.
+    bool has_converged = state.iteration == 1
+      ? false
+      : HasConverged(beta.elem(columns), new_beta);
+    beta.elem(columns) = new_beta;
+    state.betas.col(model) = beta;
+    state.iterations[model]++;
+    return !has_converged;
+  }
+
+  bool HasConverged(vec old_beta, vec new_beta) {
+    return max(abs((old_beta - new_beta) / old_beta)) < <?=$epsilon?>;
+  }
+
+  void GetResult(<?=typed_ref_args($outputs)?>) {
+    Json::Value result(Json::objectValue);
+    result["iteration"] = (Json::Value::Int64) constant_state.iteration;
+    Json::Value models(Json::arrayValue);
+<?  foreach ($modelInfo as $model => $info) { ?>
+    {
+      Json::Value model(Json::objectValue);
+      model["response"] = <?=json_encode($info['responseName'])?>;
+      model["family"] = "<?=$info['family']?>";
+      model["link"] = "<?=$info['link']?>";
+      model["converged"] = !constant_state.active[<?=$model?>];
+      model["iteration"] = (Json::Value::UInt64) constant_state.iterations[<?=$model?>];
+      ToJson(vec(constant_state.betas.col(<?=$model?>)), model["coefficients"]);
+      model["deviance"] = constant_state.deviance[<?=$model?>];
+      model["pearson"] = constant_state.pearson[<?=$model?>];
+      models.append(model);
+    }
+<?  } ?>
+    result["models"] = models;
+<?= ProduceResult(array_keys($outputs)[0], "result") ?>
+  }
+};
+
+<?  return array(
+        'kind' => 'GLA',
+        'name' => $className,
+        'system_headers' => [
+            'math.h',
+            'armadillo',
+            'iostream',
+            'boost/math/constants/constants.hpp',
+            'boost/math/special_functions/erf.hpp',
+        ],
+        'lib_headers' => ['glmFamilies', 'ArmaJson'],
+        'user_headers' => ['json.h'],
+        'iterable' => TRUE,
+        'input' => $inputs,
+        'output' => $outputs,
+        'result_type' => 'single',
+        'generated_state' => $constantState,
+        'libraries' => ['armadillo'],
+    );
+}
+?>
@@ -9,7 +9,24 @@ function G_Means_Constant_State(array $t_args)
 
 using namespace arma;
 
-// These states are detailed in the cluster class.
+// This records the current state of the algorithm for a node of the tree.
+// kMeans:         Run k-means. Multiple iterations until convergence.
+// gMeans:         Calculate XTX and split for G-Means. Single iteration.
+// kMeansChildren: Waiting for children k-means to converge.
+// jarqueBera:     Transform the data with v and calculate the Jarque Bera
+//                 statistic.
+// activeParent:   The above is complete and this cluster has children.
+// noChildren:     This cluster has been completed and has no children.
+// inactiveParent: This cluster has children but all of its offspring are
+//                 complete.
+// It should be noted that this state is a bit weird because this cluster can
+// either be a parent or a child. The child is initialized by the parent with
+// state kMeans and k-means is run on it. The child is then untouched until the
+// conclusion of G-Means on its parent, after which it is either deleted if the
+// parent is noChildren or kept and set to gMeans if the parent is activeParent.
+// The child then begins its own G-Means. The state is switched to
+// inactiveParent during a check in ShouldIterate which checks if all of its
+// offspring are noChildren or inactiveParent.
 enum class <?=$className?>State {
   kMeans,
   gMeans,
@@ -22,64 +39,193 @@ enum class <?=$className?>State {
 
 class <?=$className?>;
 
-// This is a constant node. It does not maintain any statistics that will change
-// during an iteration. It is instead copied over into the Cluster class.
+// The tree of clusters is stored as a table of nodes, with an entry in each of
+// the following arrays per node. The root is node 0 and the children of a node
+// are always adjacent, so only the index of the first child is stored. The
+// table is kept in breadth-first order, which means that the nodes near the
+// root, which are visited for every item, are contiguous in memory.
+class <?=$className?>ConstantState{
+  typedef <?=$className?>State State;
+
+ private:
+  // TODO: Maybe add a joint iteration. Probably too complicated for the average
+  // user because the intermixing of splitting, kmeans, and computations.
+  // The current iteration which is to be compared to $axIteration
+  long iteration;
+
+  // The current depth of the tree which is to be compared to $maxDepth.
+  long depth;
 
-// The variables here lack description. They are analagous to those in the cluster.
+  // The center of each node, one per column.
+  mat centers;
 
-class <?=$className?>Node {
- typedef <?=$className?>State State;
+  // The major axis of each node in the jarqueBera state, one per column. It is
+  // the difference between the two child cluster centers and has the same name
+  // as in the G-means paper.
+  mat v;
 
- private:
-  int count;
-  vec center;
-  <?=$className?>State state;
-  <?=$className?>Node *child1;
-  <?=$className?>Node *child2;
+  // The norm of each column of v, stored to avoid unnecessary computation.
+  vec v_norm;
+
+  // The state of each node.
+  std::vector<State> states;
+
+  // The index of the first child of each node, or 0 if it has no children.
+  std::vector<uword> children;
+
+  // The number of items in each node, as of its last k-means iteration.
+  std::vector<long> counts;
+
+  // The current estimate of the principal direction of each node, as a unit
+  // vector, and the corresponding eigenvalue of X^T * X. These are updated by a
+  // step of power iteration for every pass of k-means and are only used in the
+  // fused mode.
+  mat directions;
+  vec eigenvalues;
+
+  // The number of steps of power iteration performed for each node.
+  std::vector<long> power_steps;
+
+  // The change in the direction of each node during its last step of power
+  // iteration, measured as 1 - |cos|. It is 1 before the first step.
+  vec direction_changes;
+
+  // The number of passes over the data used for the statistics of each node,
+  // i.e. during which it was in the kMeans, gMeans, or jarqueBera state.
+  std::vector<long> passes;
+
+  // The number of passes over the data used for the statistics of any node at
+  // each depth of the tree.
+  std::vector<long> level_passes;
+
+  // The index of the scatter matrix used by each node in the gMeans state. The
+  // scatter matrices are large, so only those nodes are given one.
+  std::vector<uword> slots;
+
+  // The number of nodes in the gMeans state.
+  uword num_slots;
 
  public:
-  friend class <?=$className?>Cluster;
   friend class <?=$className?>;
 
-  <?=$className?>Node(const vec &_center)
-      : count(0),
-        center(_center),
-        state(State::kMeans),
-        child1(nullptr),
-        child2(nullptr) {
+  // The root is initialized with a zero vector and shifts to the mean during
+  // the first iteration.
+  <?=$className?>ConstantState()
+      : iteration(0),
+        depth(0),
+        centers(zeros<mat>(<?=$dimension?>, 1)),
+        v(zeros<mat>(<?=$dimension?>, 1)),
+        v_norm(zeros<vec>(1)),
+        states(1, State::kMeans),
+        children(1, 0),
+        counts(1, 0),
+        directions(normalise(randn<vec>(<?=$dimension?>))),
+        eigenvalues(zeros<vec>(1)),
+        power_steps(1, 0),
+        direction_changes(ones<vec>(1)),
+        passes(1, 0),
+        level_passes(),
+        slots(1, 0),
+        num_slots(0) {
   }
 
-  // A typical deconstructor for the allocated children.
-  ~<?=$className?>Node() {
-    if (child1 != nullptr) {
-      delete child1;
-      child1 = nullptr;
-    }
-    if (child2 != nullptr) {
-      delete child2;
-      child2 = nullptr;
-    }
+  // Appends two children to the table with the given centers.
+  void AddChildren(uword node, const vec& center1, const vec& center2) {
+    uword child = centers.n_cols;
+    centers.resize(<?=$dimension?>, child + 2);
+    centers.col(child) = center1;
+    centers.col(child + 1) = center2;
+    v.resize(<?=$dimension?>, child + 2);
+    v.cols(child, child + 1).zeros();
+    v_norm.resize(child + 2);
+    v_norm.subvec(child, child + 1).zeros();
+    states.resize(child + 2, State::kMeans);
+    children.resize(child + 2, 0);
+    counts.resize(child + 2, 0);
+    directions.resize(<?=$dimension?>, child + 2);
+    directions.col(child) = normalise(randn<vec>(<?=$dimension?>));
+    directions.col(child + 1) = normalise(randn<vec>(<?=$dimension?>));
+    eigenvalues.resize(child + 2);
+    eigenvalues.subvec(child, child + 1).zeros();
+    power_steps.resize(child + 2, 0);
+    direction_changes.resize(child + 2);
+    direction_changes.subvec(child, child + 1).ones();
+    passes.resize(child + 2, 0);
+    slots.resize(child + 2, 0);
+    children[node] = child;
   }
 
   // This is called at the end of every iteration and decides if a parent has
-  // become inactive.
-  bool MakeInactive() {
-    if (state == State::noChildren || state == State::inactiveParent) {
-      return true;
-    } else if (state == State::activeParent && child1->MakeInactive() && child2->MakeInactive()) {
-      state = State::inactiveParent;
-      return true;
-    } else {
-      return false;
-    };
+  // become inactive. Children always come after their parent in the table, so
+  // iterating backwards visits all of the offspring of a node before it.
+  void MakeInactive() {
+    for (uword node = states.size(); node-- > 0;) {
+      if (states[node] != State::activeParent)
+        continue;
+      uword child = children[node];
+      if (IsComplete(child) && IsComplete(child + 1))
+        states[node] = State::inactiveParent;
+    }
+  }
+
+  bool IsComplete(uword node) const {
+    return states[node] == State::noChildren
+        || states[node] == State::inactiveParent;
+  }
+
+  // Removes the nodes that are no longer in the tree, i.e. the children of the
+  // clusters that were found to be normal, and restores breadth-first order.
+  // The scatter matrices are reassigned to the nodes in the gMeans state.
+  void Compact() {
+    std::vector<uword> order(1, 0);
+    for (uword counter = 0; counter < order.size(); counter++) {
+      uword child = children[order[counter]];
+      if (child != 0) {
+        order.push_back(child);
+        order.push_back(child + 1);
+      }
+    }
+    std::vector<uword> position(states.size(), 0);
+    for (uword counter = 0; counter < order.size(); counter++)
+      position[order[counter]] = counter;
+
+    uvec indices(order.size());
+    std::vector<State> new_states(order.size());
+    std::vector<uword> new_children(order.size());
+    std::vector<long> new_counts(order.size());
+    std::vector<long> new_power_steps(order.size());
+    std::vector<long> new_passes(order.size());
+    num_slots = 0;
+    for (uword counter = 0; counter < order.size(); counter++) {
+      uword node = order[counter];
+      indices[counter] = node;
+      new_states[counter] = states[node];
+      new_children[counter] = children[node] != 0 ? position[children[node]] : 0;
+      new_counts[counter] = counts[node];
+      new_power_steps[counter] = power_steps[node];
+      new_passes[counter] = passes[node];
+    }
+    centers = mat(centers.cols(indices));
+    v = mat(v.cols(indices));
+    v_norm = vec(v_norm.elem(indices));
+    directions = mat(directions.cols(indices));
+    eigenvalues = vec(eigenvalues.elem(indices));
+    direction_changes = vec(direction_changes.elem(indices));
+    states.swap(new_states);
+    children.swap(new_children);
+    counts.swap(new_counts);
+    power_steps.swap(new_power_steps);
+    passes.swap(new_passes);
+    slots.assign(order.size(), 0);
+    for (uword node = 0; node < order.size(); node++)
+      if (states[node] == State::gMeans)
+        slots[node] = num_slots++;
   }
 
   // TODO: Change this to JSON
-  Json::Value GetOutput(int level) const {
+  Json::Value GetOutput(uword node, int level) const {
     Json::Value data(Json::objectValue);
-    //for (int counter = 0; counter < level; counter ++)
-      //cout << "    ";
-    switch (state) {
+    switch (states[node]) {
       case State::kMeans:
         data["category"] = "kmeans";
         break;
@@ -102,48 +248,24 @@ class <?=$className?>Node {
         data["category"] = "noChildren";
         break;
     }
-    //cout << center << endl;
 <?  foreach (range(0, $dimension - 1) as $counter) { ?>
-    data["center"].append(center(<?=$counter?>));
+    data["center"].append(centers(<?=$counter?>, node));
 <?  }  ?>
-    if (child1 != nullptr) data["offspring1"] = child1->GetOutput(level + 1);
-    if (child2 != nullptr) data["offspring2"] = child2->GetOutput(level + 1);
+    if (children[node] != 0) {
+      data["offspring1"] = GetOutput(children[node], level + 1);
+      data["offspring2"] = GetOutput(children[node] + 1, level + 1);
+    }
     data["depth"] = level;
-    data["count"] = count;
+    data["count"] = (Json::Value::Int64) counts[node];
+    data["passes"] = (Json::Value::Int64) passes[node];
     return data;
   }
 };
-
-class <?=$className?>ConstantState{
- private:
-  // TODO: Maybe add a joint iteration. Probably too complicated for the average
-  // user because the intermixing of splitting, kmeans, and computations.
-  // The current iteration which is to be compared to $axIteration
-  long iteration;
-
-  // The current depth of the tree which is to be compared to $maxDepth.
-  long depth;
-
-  // The root of the tree representing the hierarchy of clusters.
-  <?=$className?>Node root;
-
- public:
-  friend class <?=$className?>;
-
-  // The root is initialized with a zero vector and shifts to the mean during
-  // the first iteration.
-  <?=$className?>ConstantState()
-      : iteration(0),
-        depth(0),
-        root(zeros<vec>(<?=$dimension?>)) {
-  }
-};
 <?
   return array(
         'kind'           => 'RESOURCE',
         'name'           => $className . 'ConstantState',
         'system_headers' => array('armadillo', 'vector'),
-        'user_headers'   => array('json.h'),
         'user_headers'   => array(),
     );
 }
@@ -172,72 +294,85 @@ function G_Means(array $t_args, array $inputs, array $outputs)
     // The significance level of the Jarque-Bera test.
     $alpha = $t_args['alpha'];
 
+    // Whether the phases of each cluster are fused. Normally, a cluster uses a
+    // pass to compute X^T * X once its k-means has converged and its parent uses
+    // another pass to compute the moments for the Jarque-Bera test once the
+    // children have converged. In the fused mode:
+    // 1. Each pass of k-means on a cluster also performs a step of power
+    //    iteration on its principal direction. If the direction has converged
+    //    by the time the center has, the cluster is split without the gMeans
+    //    pass. Otherwise, the gMeans pass is used as normal. The k-means passes
+    //    are never extended for the sake of the direction.
+    // 2. The moments are accumulated during each pass of the children's k-means
+    //    by projecting onto the axis between the children at the start of that
+    //    pass. Once the children have converged, this is the final axis and the
+    //    test is performed without the jarqueBera pass.
+    $fused = get_default($t_args, 'fused', false);
+
+    // The maximum change in the principal direction, measured as 1 - |cos|, for
+    // the power iteration to have converged in the fused mode. A cluster whose
+    // direction has not converged costs one extra pass, whereas a poor direction
+    // slows the 2-means of its children.
+    $powerEpsilon = get_default($t_args, 'power.epsilon', 1e-4);
+
     $codeArray = array_combine(array_keys($inputs), range(0, $dimension - 1));
 ?>
 using namespace arma;
 using namespace std;
 
-class <?=$className?>Cluster {
+class <?=$className?>;
+
+<?  $constantState = lookupResource(
+        "statistics::G_Means_Constant_State",
+        array(
+            'className' => $className,
+            'dimension' => $dimension,
+        )
+    ); ?>
+
+// The statistics of each node are stored in arrays indexed by the nodes of the
+// constant state, so that merging two states is a single addition per array.
+class <?=$className?> {
  typedef <?=$className?>State State;
 
  private:
-  // This records the current state of the algorithm to be used in a switch.
-  // 0: Run k-means. Multiple iterations until convergence. Calculates v.
-  // 1: Calculate XTX and split for G-Means. Single iteration.
-  // 2: Waiting for children k-means to converge.
-  // 3: Transform the data with v and compute the mean.
-  // 4: Calculate the Jarque Bera statistic.
-  // 5: The above is complete and this cluster has children.
-  // 6: This cluster has been completed and has no children.
-  // 7: This cluster has children but all of its offspring are complete.
-  // TODO: Maybe switch this to a set of booleans to gain branch prediction
-  // instead of lookup table. Gets predicted almost perfectly due to low change.
-  // TODO: Maybe merge 3 and 4 - empirically test this, especially because less projections.
-  // It should be noted that this state is a bit weird because this cluster can
-  // either be a parent or a child. The child is initialized by the parent with
-  // state 0 and k-means is run on it. The child is then untouched until the
-  // conclusion of G-Means on its parent, after which it is either deleted if
-  // the parent is state 6 or kept and set to state 1 if the parent is state 5.
-  // The child is then at state 1 and begins its own G-Means. The state is
-  // switched to 7 during a check in ShouldIterate whichs checks if all of its
-  // offspring are state 6 or 7.
-  State state;
-
-  // The center of this cluster.
-  vec center;
-
-  // The children nodes that partition this cluster.
-  <?=$className?>Cluster *child1;
-  <?=$className?>Cluster *child2;
-
-  // The sum of the element in this cluster; used to calculate the centroid.
-  vec sum;
-
-  // The total number of elements in the cluster. Incremented by the AddItem
-  // class function and used to calculate the centroid.
-  long count;
-
-  // This represents X^T * X where X is the data matrix for this cluster. It is
-  // needed for principal component analysis in order to split the cluster.
-  // It is the first thing done when a new cluster is made.
-  mat XTX;
-
-  // This represents a major axis of the cluster and is the difference between
-  // the two child cluster centers. It has the same name as in the G-means paper
-  vec v;
-
-  // This is the norm of v, stored to avoid unnecessary computation.
-  double v_norm;
+  // The typical constant state for an iterable GLA.
+  const <?=$constantState?> & constant_state;
+
+  // The sum of the items in each node in the kMeans state, one per column; used
+  // to calculate the centroid.
+  mat sums;
+
+  // The total number of items in each node in the kMeans state. Used to
+  // calculate the centroid.
+  vec counts;
+
+  // This represents X^T * X where X is the centered data matrix for a node in
+  // the gMeans state. It is needed for principal component analysis in order
+  // to split the cluster. There is one slice per node in the gMeans state.
+  cube scatters;
+<?  if ($fused) { ?>
+
+  // The product of X^T * X and the current direction of each node in the
+  // kMeans state, where X is centered on the current center rather than the
+  // mean. This is corrected once the mean is known.
+  mat products;
+<?  } ?>
 
   // These are used in the calculation of the Jarque-Bera statistics, i.e. the
-  // skewness and kurtosis.
+  // skewness and kurtosis. For each node in the jarqueBera state, or in the
+  // kMeansChildren state in the fused mode, the rows are the sums of the
+  // projections raised to the first through fourth power.
+  mat moments;
 
-  // The following 4 variables stored the sum of the projections raised to
-  // various values, as specified by their suffix.
-  long double sum_first;
-  long double sum_second;
-  long double sum_third;
-  long double sum_fourth;
+  // A vector whose elements will be individually set to contain the current
+  // item's data. The data is packaged as a vector due to the reliance on
+  // armadillo. This exists as a member variable as opposed to a local variable
+  // in order to avoid repeated memory allocation.
+  vec item;
+
+  // The item after subtracting the center of a node.
+  vec shifted_item;
 
   // The scalar value of the projection of the item unto the axis, v. It is
   // stored to avoid recomputation for each of the 3 above statistics.
@@ -247,305 +382,351 @@ class <?=$className?>Cluster {
   // products.
   double dummy_term;
 
- public:
-  friend class <?=$className?>;
+  // Whether any node at each depth used the last pass. Only used in
+  // ShouldIterate.
+  std::vector<bool> active_levels;
 
-  <?=$className?>Cluster(const <?=$className?>Node &node)
-      : sum_first(0),
-        sum_second(0),
-        sum_third(0),
-        sum_fourth(0),
-        count(node.count),
-        state(node.state),
-        center(node.center),
-        sum(zeros<vec>(<?=$dimension?>)),
-        XTX (zeros<mat>(<?=$dimension?>, <?=$dimension?>)) {
-    switch (state) {
-      case State::kMeansChildren:
-        child1 = new <?=$className?>Cluster(*node.child1);
-        child2 = new <?=$className?>Cluster(*node.child2);
-        break;
-      case State::jarqueBera:
-        child1 = new <?=$className?>Cluster(*node.child1);
-        child2 = new <?=$className?>Cluster(*node.child2);
-        v = child1->center - child2->center;
-        v_norm = norm(v, <?=$pMinkowski?>);
-        break;
-      case State::activeParent:
-      case State::inactiveParent:
-        child1 = new <?=$className?>Cluster(*node.child1);
-        child2 = new <?=$className?>Cluster(*node.child2);
-        break;
-      default:
-        child1 = nullptr;
-        child2 = nullptr;
-    }
+ public:
+  <?=$className?>(const <?=$constantState?> & state)
+      : constant_state(state),
+        sums(zeros<mat>(<?=$dimension?>, state.states.size())),
+        counts(zeros<vec>(state.states.size())),
+<?  if ($fused) { ?>
+        scatters(zeros<cube>(<?=$dimension?>, <?=$dimension?>,
+                             state.iteration == 0 ? 1 : state.num_slots)),
+<?  } else { ?>
+        scatters(zeros<cube>(<?=$dimension?>, <?=$dimension?>, state.num_slots)),
+<?  } ?>
+<?  if ($fused) { ?>
+        products(zeros<mat>(<?=$dimension?>, state.states.size())),
+<?  } ?>
+        moments(zeros<mat>(4, state.states.size())),
+        item(<?=$dimension?>),
+        shifted_item(<?=$dimension?>),
+        active_levels() {
   }
 
-  ~<?=$className?>Cluster() {
-    if (child1 != nullptr) {
-      delete child1;
-      child1 = nullptr;
-    }
-    if (child2 != nullptr) {
-      delete child2;
-      child2 = nullptr;
+  <?=$className?>(const <?=$className?> &)=delete;
+  <?=$className?> & operator =(const <?=$className?> &)=delete;
+
+  // The item is passed down the tree until it reaches the node whose statistics
+  // it contributes to. The root is set to the center after the first iteration.
+  // However, its state needs to be manually changed, which is done in
+  // ShouldIterate.
+  void AddItem(<?=const_typed_ref_args($inputs)?>) {
+<?  foreach ($codeArray as $name => $counter) { ?>
+    item[<?=$counter?>] = <?=$name?>;
+<?  } ?>
+    uword node = 0;
+    while (true) {
+      switch (constant_state.states[node]) {
+        case State::kMeans:
+          counts[node] ++;
+          sums.col(node) += item;
+<?  if ($fused) { ?>
+          // The root is split after its first pass, so X^T * X is accumulated
+          // about the origin alongside the mean and corrected afterwards.
+          if (constant_state.iteration == 0) {
+            scatters.slice(0) += item * trans(item);
+            return;
+          }
+          shifted_item = item - constant_state.centers.col(node);
+          products.col(node)
+              += shifted_item * dot(shifted_item, constant_state.directions.col(node));
+<?  } ?>
+          return;
+        case State::gMeans:  // Add to the PVA matrix.
+          shifted_item = item - constant_state.centers.col(node);
+          scatters.slice(constant_state.slots[node])
+              += shifted_item * trans(shifted_item);
+          return;
+        case State::kMeansChildren:  // Filter the data for k-means.
+<?  if ($fused) { ?>
+          // The moments for the Jarque-Bera test are computed alongside.
+          AddMoments(node);
+<?  } ?>
+          // Falls through.
+        case State::activeParent: {  // Filter the data onwards.
+          uword child = constant_state.children[node];
+          node = GetDistance(child) < GetDistance(child + 1) ? child : child + 1;
+          break;
+        }
+        case State::jarqueBera:  // Compute kurtosis and skewness.
+          AddMoments(node);
+          return;
+        default:  // Nothing happens for other two cases.
+          return;
+      }
     }
   }
 
-  <?=$className?>Cluster(const <?=$className?>Cluster &)=delete;
-  <?=$className?>Cluster & operator =(const <?=$className?>Cluster &)=delete;
-
-  // This function recalculates the statistics of the cluster upon adding a
-  // point, i.e. the data item. It is call AddItem only for sake of consistency
-  // and this name is not relevant to Datapath - this function is only ever
-  // called by AddItem of the GLA below.
-  // TODO: Maybe change from switch to if-else block for prediction?
-  void AddItem(vec &point) {
-    switch (state) {
-      case State::kMeans:
-        count ++;
-        sum += point;
-        break;
-      case State::gMeans:  // Add to the PVA matrix.
-        XTX += (point - center) * trans(point - center);
-        break;
-      case State::kMeansChildren:  // Filter the data for k-means.
-        if (child1->GetDistance(point) < child2->GetDistance(point))
-          child1->AddItem(point);
-        else
-          child2->AddItem(point);
-        break;
-      case State::jarqueBera:  // Compute kurtosis and skewness.
-        projection  = dot(point, v) / v_norm;
-        sum_first  += projection;
-        dummy_term = projection * projection;
-        sum_second += dummy_term;
-        dummy_term *= projection;
-        sum_third  += dummy_term;
-        sum_fourth += dummy_term * projection;
-        break;
-      case State::activeParent:  // Filter the data onwards.
-        if (child1->GetDistance(point) < child2->GetDistance(point))
-          child1->AddItem(point);
-        else
-          child2->AddItem(point);
-        break;
-      // Nothing happens for other two cases.
-    }
+  // Adds the powers of the projection of the item onto the axis of the node.
+  void AddMoments(uword node) {
+    projection = dot(item, constant_state.v.col(node))
+               / constant_state.v_norm[node];
+    moments(0, node) += projection;
+    dummy_term = projection * projection;
+    moments(1, node) += dummy_term;
+    dummy_term *= projection;
+    moments(2, node) += dummy_term;
+    moments(3, node) += dummy_term * projection;
   }
 
-  // Combines the statistics for two clusters. These clusters should not have
-  // two different centers; rather, they should be two equivalent clusters from
-  // two different states of the GLA below. Like AddItem, the name is for the
-  // sake of consistency and is not relevant to Datapath - this function is only
-  // ever called by AddState of the GLA below.
-  void AddState(<?=$className?>Cluster & other) {
-    switch (state) {
-      case State::kMeans: {  // Typical kMeans AddState
-        count += other.count;
-        sum   += other.sum;
-        break;
-      }
-      case State::gMeans:  // Add to the PVA matrix.
-        XTX += other.XTX;
-        break;
-      case State::kMeansChildren:  // Sum the 2 K-means children.
-        child1->AddState(*other.child1);
-        child2->AddState(*other.child2);
-        break;
-      case State::jarqueBera:  // Compute the sum of moments and counts.
-        sum_first += other.sum_first;
-        sum_second += other.sum_second;
-        sum_third  += other.sum_third;
-        sum_fourth += other.sum_fourth;
-        break;
-      case State::activeParent:  // Filter the state down the tree.
-        child1->AddState(*other.child1);
-        child2->AddState(*other.child2);
-        break;
-      // Nothing happens for other two cases.
-    }
+  void AddState(<?=$className?> &other) {
+    sums     += other.sums;
+    counts   += other.counts;
+    scatters += other.scatters;
+<?  if ($fused) { ?>
+    products += other.products;
+<?  } ?>
+    moments  += other.moments;
   }
 
-  // This is called during the ShouldIterate step of the GLA.
-  void DoIteration(<?=$className?>Node &node) {
-    switch (state) {
+  // This is called for each node that was reached by the data during the last
+  // iteration, starting with the root. Nodes are only appended during this, so
+  // the indices of the existing nodes remain valid. For a node in the kMeans
+  // state, this returns whether it has converged.
+  bool DoIteration(uword node, uword level, <?=$constantState?> & modible_state) {
+    switch (modible_state.states[node]) {
       case State::kMeans: {  // Move center to centroid
-        node.center = sum / count;
-        node.count = count;
-        break;
+        RecordPass(node, level, modible_state);
+        vec previous_center = modible_state.centers.col(node);
+        modible_state.centers.col(node) = sums.col(node) / counts[node];
+        modible_state.counts[node] = counts[node];
+<?  if ($fused) { ?>
+        if (modible_state.iteration > 0)
+          StepDirection(node, previous_center, modible_state);
+<?  } ?>
+        return HasConverged(previous_center, modible_state.centers.col(node));
       }
       case State::gMeans: {  // Find eigenvalues and find PCA
         // TODO: See if power iteration or armadillo function is faster.
         // TODO: See when DC is faster (probably doesn't matter).
-        vec eigenvalues;
-        mat eigenvectors;
-        uword index;
-        eig_sym(eigenvalues, eigenvectors, XTX);
-        eigenvalues = abs(eigenvalues);
-        double max_eigenvalue = eigenvalues.max(index);
-        vec max_eigenvector = eigenvectors.col(index);
-        // Norm probably not needed, just a safeguard.
-        v = max_eigenvector * sqrt(max_eigenvalue / (count > 1 ? count - 1 : 1))
-          / (norm(max_eigenvector, <?=$pMinkowski?>) * ROOT_HALF_PI);
-        node.child1 = new <?=$className?>Node(center + v);
-        node.child2 = new <?=$className?>Node(center - v);
-        node.state = State::kMeansChildren;
+        RecordPass(node, level, modible_state);
+        SplitAlongScatter(node, scatters.slice(modible_state.slots[node]),
+                          modible_state);
         break;
       }
       case State::kMeansChildren: {  // Check for convergence and advance k-means.
-        vec previous_center1 = child1->center;
-        vec previous_center2 = child2->center;
-        child1->DoIteration(*node.child1);
-        child2->DoIteration(*node.child2);
+        uword child = modible_state.children[node];
+        // Both children must be advanced, so these are not combined.
+        bool has_converged1 = DoIteration(child, level + 1, modible_state);
+        bool has_converged2 = DoIteration(child + 1, level + 1, modible_state);
         // TODO: Maybe make one child stop if it converges and the other doesn't
-        if (   HasConverged(previous_center1, node.child1->center)
-            && HasConverged(previous_center2, node.child2->center)) {
-          node.state = State::jarqueBera;
-          node.child1->state = State::gMeans;
-          node.child2->state = State::gMeans;
+        if (has_converged1 && has_converged2) {
+<?  if ($fused) { ?>
+          if (IsNormal(node, modible_state)) {
+            // The children are removed from the table by Compact.
+            modible_state.states[node] = State::noChildren;
+            modible_state.children[node] = 0;
+          } else {
+            modible_state.states[node] = State::activeParent;
+            SplitOrScatter(child, modible_state);
+            SplitOrScatter(child + 1, modible_state);
+          }
+<?  } else { ?>
+          modible_state.states[node] = State::jarqueBera;
+          modible_state.states[child] = State::gMeans;
+          modible_state.states[child + 1] = State::gMeans;
+          SetAxis(node, modible_state);
+<?  } ?>
         } else {
-          node.child1->count = 0;
-          node.child2->count = 0;
+          modible_state.counts[child] = 0;
+          modible_state.counts[child + 1] = 0;
+<?  if ($fused) { ?>
+          SetAxis(node, modible_state);
+<?  } ?>
         }
         break;
       }
       case State::jarqueBera: { // Compute kurtosis and skewness; run test.
-        // TODO: Maybe use D'Agostino's K-squared Test (or let the user choose).
-        long double variance;
-        long double kurtosis;
-        long double skewness;
-        long double JB_statistic;
-        long double p_value;
-        double mean = sum_first / count;
-        variance = sum_second
-                 - 2 * mean * sum_first
-                 + pow(mean, 2);
-        kurtosis = sum_fourth
-                 - 4 * mean * sum_third
-                 + 6 * pow(mean, 2) * sum_second
-                 - 4 * pow(mean, 3) * sum_first
-                 + pow(mean, 4);
-        skewness = sum_third
-                 - 3 * mean * sum_second
-                 + 3 * pow(mean, 2) * sum_first
-                 - pow(mean, 3);
-        kurtosis *= count / pow(variance, 2);
-        skewness *= sqrt(count) / pow(variance, 1.5);
-        JB_statistic = (pow(skewness, 2) + pow(kurtosis - 3, 2) / 4)
-                     * (count / 6);
-        // This is equivalent to the Chi squared distribution.
-        p_value = boost::math::gamma_p(1.0, JB_statistic / 2);
-        if (1 - p_value < <?=$alpha?>) {
-          // The data data is not normally distributed, keep the sub clusters.
-          node.state = State::activeParent;
+        RecordPass(node, level, modible_state);
+        if (IsNormal(node, modible_state)) {
+          // The children are removed from the table by Compact.
+          modible_state.states[node] = State::noChildren;
+          modible_state.children[node] = 0;
         } else {
-          // The copy from cluster to node will not copy the children.
-          node.state = State::noChildren;
-          delete node.child1;
-          node.child1 = nullptr;
-          delete node.child2;
-          node.child2 = nullptr;
+          // The data data is not normally distributed, keep the sub clusters.
+          modible_state.states[node] = State::activeParent;
         }
         break;
       }
       case State::activeParent: { // Filter the state down the tree.
-        child1->DoIteration(*node.child1);
-        child2->DoIteration(*node.child2);
+        uword child = modible_state.children[node];
+        DoIteration(child, level + 1, modible_state);
+        DoIteration(child + 1, level + 1, modible_state);
         break;
       }
       // Nothing happens for other two cases.
     }
+    return false;
   }
 
-  // Calculation of centroid in order to reposition the center of this cluster
-  // for the next iteration.
-  vec GetResult() {
-    return sum / count;
+  // Creates the children of a node along the principal direction of the given
+  // scatter matrix, X^T * X.
+  void SplitAlongScatter(uword node, const mat& scatter,
+                         <?=$constantState?> & modible_state) {
+    vec eigenvalues;
+    mat eigenvectors;
+    uword index;
+    eig_sym(eigenvalues, eigenvectors, scatter);
+    eigenvalues = abs(eigenvalues);
+    double max_eigenvalue = eigenvalues.max(index);
+    vec max_eigenvector = eigenvectors.col(index);
+    Split(node, max_eigenvector, max_eigenvalue, modible_state);
   }
 
-  // GetDistance from a given point to the center of the cluster. Used to decide
-  // which cluster to move a point to in the iterative step. Based on the
-  // armadillo implementation of norm which is pre-built to calculate Minkowski
-  // distance.
-  double GetDistance(vec point) {
-    return norm(center - point, <?=$pMinkowski?>);
+  // Creates the children of a node along the given principal direction, where
+  // eigenvalue is the corresponding eigenvalue of X^T * X.
+  void Split(uword node, vec direction, double eigenvalue,
+             <?=$constantState?> & modible_state) {
+    long count = modible_state.counts[node];
+    // Norm probably not needed, just a safeguard.
+    vec v = direction * sqrt(eigenvalue / (count > 1 ? count - 1 : 1))
+          / (norm(direction, <?=$pMinkowski?>) * ROOT_HALF_PI);
+    vec center = modible_state.centers.col(node);
+    modible_state.AddChildren(node, center + v, center - v);
+    modible_state.states[node] = State::kMeansChildren;
+<?  if ($fused) { ?>
+    SetAxis(node, modible_state);
+<?  } ?>
   }
 
-  // Checks if kMeans has converged. Declared here for correct scoping.
-  bool HasConverged(vec old_center, vec new_center) {
-    return max(abs((old_center - new_center) / old_center)) < <?=$epsilon?>;
+  // Sets the axis of a node to the difference between its children's centers.
+  void SetAxis(uword node, <?=$constantState?> & modible_state) {
+    uword child = modible_state.children[node];
+    modible_state.v.col(node) = modible_state.centers.col(child)
+                              - modible_state.centers.col(child + 1);
+    modible_state.v_norm[node] = norm(modible_state.v.col(node), <?=$pMinkowski?>);
   }
-};
-
-class <?=$className?>;
-
-<?  $constantState = lookupResource(
-        "statistics::G_Means_Constant_State",
-        array(
-            'className' => $className,
-            'dimension' => $dimension,
-        )
-    ); ?>
-
-class <?=$className?> {
- typedef <?=$className?>State State;
-
- private:
-  // The typical constant state for an iterable GLA.
-  const <?=$constantState?> & constant_state;
-
-  // This is the root cluster; the full tree will be initialized with a single
-  // call to the constructor due to the recursive structure of the constructor.
-  <?=$className?>Cluster root;
-
-  // A vector whose elements will be individually set to contain the current
-  // item's data. The data is packaged as a vector due to the reliance on
-  // armadillo. This exists as a member variable as opposed to a local variable
-  // in order to avoid repeated memory allocation.
-  vec item;
-
- public:
-  <?=$className?>(const <?=$constantState?> & state)
-      : constant_state(state),
-        root(state.root),
-        item(<?=$dimension?>) {
+<?  if ($fused) { ?>
+
+  // Performs a step of power iteration on the principal direction of a node.
+  // The products were computed about the previous center, c, rather than the
+  // mean, m, and X^T * X is corrected using the identity
+  //   sum (x - c)(x - c)^T = sum (x - m)(x - m)^T + n (m - c)(m - c)^T.
+  void StepDirection(uword node, const vec& previous_center,
+                     <?=$constantState?> & modible_state) {
+    auto direction = modible_state.directions.col(node);
+    vec offset = modible_state.centers.col(node) - previous_center;
+    vec product = products.col(node) - counts[node] * offset * dot(offset, direction);
+    double eigenvalue = norm(product, 2);
+    modible_state.power_steps[node]++;
+    // Every item is at the center, so there is no direction to find.
+    if (eigenvalue == 0) {
+      modible_state.direction_changes[node] = 0;
+      return;
+    }
+    product /= eigenvalue;
+    modible_state.direction_changes[node] = 1 - std::abs(dot(product, direction));
+    direction = product;
+    modible_state.eigenvalues[node] = eigenvalue;
   }
 
-  <?=$className?>(const <?=$className?> &)=delete;
-  <?=$className?> & operator =(const <?=$className?> &)=delete;
-
-  void AddItem(<?=const_typed_ref_args($inputs)?>) {
-<?  foreach ($codeArray as $name => $counter) { ?>
-    item[<?=$counter?>] = <?=$name?>;
+  // Splits a node whose k-means has converged along the direction found by
+  // power iteration if that has converged as well. Otherwise, the node moves to
+  // the gMeans state, where the direction is found from X^T * X.
+  void SplitOrScatter(uword node, <?=$constantState?> & modible_state) {
+    if (modible_state.direction_changes[node] <= <?=$powerEpsilon?>)
+      Split(node, modible_state.directions.col(node),
+            modible_state.eigenvalues[node], modible_state);
+    else
+      modible_state.states[node] = State::gMeans;
+  }
 <?  } ?>
-    // This will automatically make so that the root is set to the center after
-    // the first iteration. However, its state needs to be manually changed,
-    // which is done in ShouldIterate.
-    root.AddItem(item);
+
+  // Performs the Jarque-Bera test on the moments of the projections onto the
+  // axis of a node. Returns whether the data is normally distributed.
+  bool IsNormal(uword node, <?=$constantState?> & modible_state) {
+    // TODO: Maybe use D'Agostino's K-squared Test (or let the user choose).
+    long count = modible_state.counts[node];
+    long double sum_first  = moments(0, node);
+    long double sum_second = moments(1, node);
+    long double sum_third  = moments(2, node);
+    long double sum_fourth = moments(3, node);
+    long double variance;
+    long double kurtosis;
+    long double skewness;
+    long double JB_statistic;
+    long double p_value;
+    double mean = sum_first / count;
+    variance = sum_second
+             - 2 * mean * sum_first
+             + pow(mean, 2);
+    kurtosis = sum_fourth
+             - 4 * mean * sum_third
+             + 6 * pow(mean, 2) * sum_second
+             - 4 * pow(mean, 3) * sum_first
+             + pow(mean, 4);
+    skewness = sum_third
+             - 3 * mean * sum_second
+             + 3 * pow(mean, 2) * sum_first
+             - pow(mean, 3);
+    kurtosis *= count / pow(variance, 2);
+    skewness *= sqrt(count) / pow(variance, 1.5);
+    JB_statistic = (pow(skewness, 2) + pow(kurtosis - 3, 2) / 4)
+                 * (count / 6);
+    // This is equivalent to the Chi squared distribution.
+    p_value = boost::math::gamma_p(1.0, JB_statistic / 2);
+    return 1 - p_value >= <?=$alpha?>;
   }
 
-  void AddState(<?=$className?> &other) {
-    root.AddState(other.root);
+  // Records that a node at the given depth used the last pass.
+  void RecordPass(uword node, uword level, <?=$constantState?> & modible_state) {
+    modible_state.passes[node]++;
+    if (level >= active_levels.size())
+      active_levels.resize(level + 1, false);
+    active_levels[level] = true;
   }
 
   bool ShouldIterate(<?=$constantState?> & modible_state) {
-    // All the iterations are processed in the clusters and copied to node.
-    root.DoIteration(modible_state.root);
+    active_levels.assign(active_levels.size(), false);
+    DoIteration(0, 0, modible_state);
+<?  if ($fused) { ?>
+    // The root is split right after its first pass, which found its mean and
+    // X^T * X about the origin. The latter is centered using the identity
+    // sum x x^T = sum (x - m)(x - m)^T + n m m^T.
+    if (constant_state.iteration == 0) {
+      vec mean = modible_state.centers.col(0);
+      SplitAlongScatter(0, scatters.slice(0) - counts[0] * mean * trans(mean),
+                        modible_state);
+    }
+<?  } else { ?>
     // Manually increment root's state from computing the mean to G-Means
     if (constant_state.iteration == 0)
-      modible_state.root.state = State::gMeans;
-    modible_state.root.MakeInactive();
+      modible_state.states[0] = State::gMeans;
+<?  } ?>
+    if (modible_state.level_passes.size() < active_levels.size())
+      modible_state.level_passes.resize(active_levels.size(), 0);
+    for (uword level = 0; level < active_levels.size(); level++)
+      modible_state.level_passes[level] += active_levels[level];
+    modible_state.MakeInactive();
+    modible_state.Compact();
     modible_state.iteration ++;
-    return modible_state.root.state != State::inactiveParent
+    return modible_state.states[0] != State::inactiveParent
            && modible_state.iteration < 30;
   }
 
+  // GetDistance from the current item to the center of a node. Used to decide
+  // which child to move a point to. Based on the armadillo implementation of
+  // norm which is pre-built to calculate Minkowski distance.
+  double GetDistance(uword node) {
+    return norm(constant_state.centers.col(node) - item, <?=$pMinkowski?>);
+  }
+
+  // Checks if kMeans has converged. Declared here for correct scoping.
+  bool HasConverged(const vec& old_center, const vec& new_center) {
+    return max(abs((old_center - new_center) / old_center)) < <?=$epsilon?>;
+  }
+
   void GetResult(<?=typed_ref_args($outputs)?>) {
-    Json::Value result = constant_state.root.GetOutput(0);
+    Json::Value result = constant_state.GetOutput(0, 0);
     result["iteration"] = (int) constant_state.iteration;
-    cout << result << endl;
+    Json::Value level_passes(Json::arrayValue);
+    for (long passes : constant_state.level_passes)
+      level_passes.append((Json::Value::Int64) passes);
+    result["level_passes"] = level_passes;
+<?= ProduceResult(array_keys($outputs)[0], "result") ?>
   }
 };
 
@@ -554,6 +735,7 @@ class <?=$className?> {
         'kind'             => 'GLA',
         'name'             => $className,
         'system_headers'   => array('armadillo', 'vector', 'string', 'iostream',
+                                    'cmath',
                                     'boost/math/special_functions/gamma.hpp',
                                     'boost/math/constants/constants.hpp'),
         'user_headers'     => array(),
@@ -9,6 +9,13 @@ function Histogram(array $t_args, array $inputs, array $outputs)
     $normalize = get_default($t_args, 'normalize', false);
     $p = get_default($t_args, 'p', 1);
 
+    // The counts of a previous histogram can be loaded from the snapshot at the
+    // path given by previous, in which case they are added to the counts of the
+    // new data. If snapshot is given, the final counts are written to that path
+    // before normalization, allowing the histogram to be updated incrementally.
+    $previous = get_default($t_args, 'previous', null);
+    $snapshot = get_default($t_args, 'snapshot', null);
+
     // Initialization of local variables from input names.
     $index = array_keys($inputs)[0];  // Index of the corresponding point.
 
@@ -22,7 +29,7 @@ function Histogram(array $t_args, array $inputs, array $outputs)
                             ['type' => $arrayInnerType, 'size' => $length]);
     array_set_index($outputs, 0, $arrayType);
 
-    $sys_headers = ['armadillo'];
+    $sys_headers = ['armadillo', 'stdexcept'];
     $user_headers = [];
     $lib_headers = [];
     $libraries = ['armadillo'];
@@ -57,6 +64,23 @@ class <?=$className?> {
   }
 
   void GetResult(<?=typed_ref_args($outputs)?>) {
+<?  if ($previous) { ?>
+    // This is only done for the final state, so the previous counts are only
+    // included once.
+    ivec previous;
+    if (!previous.load("<?=addcslashes($previous, '"\\')?>", arma_binary)
+        || previous.n_elem != kLength)
+      throw std::runtime_error(
+          "Histogram: the snapshot <?=addcslashes($previous, '"\\')?> could "
+          "not be loaded or has the wrong length.");
+    bins += previous;
+<?  } ?>
+<?  if ($snapshot) { ?>
+    if (!bins.save("<?=addcslashes($snapshot, '"\\')?>", arma_binary))
+      throw std::runtime_error(
+          "Histogram: the snapshot could not be written to "
+          "<?=addcslashes($snapshot, '"\\')?>.");
+<?  } ?>
 <?  if ($normalize) { ?>
     bins = normalise(bins, <?=$p?>);
 <?  } ?>
@@ -0,0 +1,452 @@
+<?
+// This GLA performs k-means clustering using a single pass over the data. This
+// is done via the following:
+// 1. Each state summarizes the items it has processed by merge-and-reduce. The
+//    items are buffered and each full buffer becomes a coreset at level 0,
+//    i.e. a set of weighted representatives. Whenever two coresets exist at
+//    the same level, they are merged and reduced into one at the next level.
+// 2. A reduction picks coreset.size of the representatives by sensitivity
+//    sampling. A bicriteria solution of k seeds is found by weighted D^2
+//    sampling, which bounds how much each representative can matter to any
+//    clustering. The picks are drawn in proportion to these bounds and are
+//    weighted by the inverse of their probability. A reduction of m
+//    representatives costs O(m * k * d), i.e. O(k * d) per representative.
+//    As a coreset at level h stands for coreset.size * 2^h items, the weight
+//    of an item is only reduced O(log(N / coreset.size)) times, so the cost
+//    per item is O(k * d * log(N / coreset.size)).
+// 3. States are merged level by level in the same manner.
+// 4. Weighted k-means++ and Lloyd's algorithm are performed on the union of
+//    the buffer and the coresets of every level, without any further passes
+//    over the data.
+// The total weight of the coresets is always the number of items processed.
+
+// Template Args:
+// number.clusters: The number of clusters, k.
+// coreset.size:    The number of representatives kept after each reduction.
+// max.iteration:   The maximum number of iterations of Lloyd's algorithm.
+// epsilon:         The maximum change in a center allowed for convergence.
+function K_Means_Coreset_Constant_State(array $t_args)
+{
+    // Grabbing variables from $t_args
+    $className      = $t_args['className'];
+    $numberClusters = $t_args['numberClusters'];
+    $numNumeric     = $t_args['numNumeric'];
+?>
+using namespace arma;
+using namespace std;
+
+class <?=$className?>ConstantState {
+ private:
+  // The number of iterations of Lloyd's algorithm performed on the coreset.
+  long iteration;
+
+  // The final cluster centers, one per column.
+  mat::fixed<<?=$numNumeric?>, <?=$numberClusters?>> centers;
+
+ public:
+  friend class <?=$className?>;
+
+  <?=$className?>ConstantState()
+      : iteration(0),
+        centers(fill::zeros) {
+  }
+};
+<?
+    return [
+        'kind' => 'RESOURCE',
+        'name' => $className . 'ConstantState',
+        'system_headers' => array('armadillo'),
+        'user_headers' => array(),
+    ];
+}
+
+function K_Means_Coreset(array $t_args, array $inputs, array $outputs)
+{
+    // Class name is randomly generated
+    $className = generate_name("KMCore");
+
+    // Setting output type
+    $outputs = ['_output' => lookupType('JSON')];
+
+    // Processing of template arguments
+    $numberClusters = $t_args['number.clusters'];
+    $coresetSize    = get_default($t_args, 'coreset.size', 20 * $numberClusters);
+    $maxIteration   = get_default($t_args, 'max.iteration', 100);
+    $epsilon        = get_default($t_args, 'epsilon', 0);
+
+    // The scale of the sensitivity bounds for a bicriteria solution found by
+    // D^2 sampling, as given by Bachem, Lucic and Krause (2017).
+    $alpha = 16 * (log($numberClusters) + 2);
+
+    grokit_assert($coresetSize >= $numberClusters,
+                  "The coreset must be at least as large as the clusters.");
+
+    // The dimension of the data, i.e. how many elements are in each item.
+    $dimension = count($inputs);
+
+    $input_types = array_values($inputs);
+
+    // Checking if input is pre-vectorized.
+    if ($dimension == 1 && $input_types[0]->is("array")) {
+        grokit_assert($input_types[0]->get("type")->is("numeric"),
+                      "Non-numeric input given.");
+        $vectorized = true;
+        $numNumeric = $input_types[0]->get("size");
+    } else {
+        foreach ($inputs as $input)
+            grokit_assert($input->is("numeric"), "Non-numeric input given.");
+        $numNumeric = $dimension;
+        $vectorized = false;
+    }
+
+    $codeArray = array_combine(array_keys($inputs), range(0, $dimension - 1));
+?>
+
+using namespace arma;
+using namespace std;
+
+class <?=$className?>;
+
+<?  $constantState = lookupResource(
+        "statistics::K_Means_Coreset_Constant_State",
+        array(
+            'className'      => $className,
+            'numNumeric'     => $numNumeric,
+            'numberClusters' => $numberClusters,
+        )
+    ); ?>
+
+class <?=$className?> {
+ public:
+  // The number of representatives in each coreset, which is also the number
+  // of items buffered before they become a coreset.
+  static const constexpr uword kSize = <?=$coresetSize?>;
+
+ private:
+  // The typical constant state for an iterable GLA.
+  const <?=$constantState?> & constant_state;
+
+  // The items not yet in a coreset, one per column. Only the first size columns
+  // are used. This is dynamically allocated because it is too large for a
+  // fixed matrix.
+  mat buffer;
+
+  // The number of items currently buffered.
+  uword size;
+
+  // The representatives and their weights for the coreset at each level, one
+  // representative per column. A level without a coreset has no columns.
+  std::vector<mat> level_points;
+  std::vector<rowvec> level_weights;
+
+  // The union of the buffer and the coresets, which is clustered at the end.
+  mat points;
+
+  // The weight of each representative, i.e. how many items it stands for.
+  rowvec weights;
+
+  // The squared distance between each representative and its nearest pick.
+  rowvec min_distances;
+
+  // The index of the nearest pick for each representative during a reduction.
+  uvec nearest;
+
+  // The sensitivity of each representative during a reduction, i.e. an upper
+  // bound on the share of the cost of any clustering that it accounts for.
+  rowvec sensitivities;
+
+  // The number of times each representative is drawn during a reduction.
+  uvec draws;
+
+  // A random engine used to generate random variates. Each state has its own.
+  std::default_random_engine generator;
+
+  // Used to perform weighted sampling.
+  std::uniform_real_distribution<double> uniform_distribution;
+
+  // The weighted sum of squared distances between each representative and its
+  // nearest center, computed after clustering.
+  double total_score;
+
+ public:
+  <?=$className?>(const <?=$constantState?> & state)
+      : constant_state(state),
+        buffer(<?=$numNumeric?>, kSize),
+        size(0),
+        level_points(),
+        level_weights(),
+        points(),
+        weights(),
+        min_distances(2 * kSize),
+        nearest(2 * kSize),
+        sensitivities(2 * kSize),
+        draws(2 * kSize),
+        generator(std::random_device()()),
+        uniform_distribution(0.0, 1.0),
+        total_score(0) {
+  }
+
+  void AddItem(<?=const_typed_ref_args($inputs)?>) {
+<?  if ($vectorized) { ?>
+    buffer.col(size) = vec(<?=array_keys($inputs)[0]?>.data(), <?=$numNumeric?>);
+<?  } else { ?>
+<?      foreach ($codeArray as $name => $counter) { ?>
+    buffer(<?=$counter?>, size) = <?=$name?>;
+<?      } ?>
+<?  } ?>
+    if (++size == kSize)
+      FlushBuffer();
+  }
+
+  void AddState(<?=$className?> & other) {
+    for (uword level = 0; level < other.level_points.size(); level++)
+      if (other.level_points[level].n_cols > 0)
+        Insert(other.level_points[level], other.level_weights[level], level);
+    for (uword counter = 0; counter < other.size; counter++) {
+      buffer.col(size) = other.buffer.col(counter);
+      if (++size == kSize)
+        FlushBuffer();
+    }
+  }
+
+  // Turns the full buffer into a coreset at level 0.
+  void FlushBuffer() {
+    mat new_points = buffer;
+    rowvec new_weights = ones<rowvec>(kSize);
+    Insert(new_points, new_weights, 0);
+    size = 0;
+  }
+
+  // Places a coreset at the given level. While there is already a coreset at
+  // that level, the two are merged and reduced into the next level.
+  void Insert(mat new_points, rowvec new_weights, uword level) {
+    while (level < level_points.size() && level_points[level].n_cols > 0) {
+      new_points = join_rows(level_points[level], new_points);
+      new_weights = join_rows(level_weights[level], new_weights);
+      level_points[level].reset();
+      level_weights[level].reset();
+      Reduce(new_points, new_weights);
+      level++;
+    }
+    if (level >= level_points.size()) {
+      level_points.resize(level + 1);
+      level_weights.resize(level + 1);
+    }
+    level_points[level] = std::move(new_points);
+    level_weights[level] = std::move(new_weights);
+  }
+
+  // Updates min_distances for the first num_points columns of the given points
+  // with their squared distance to the given point, if it is nearer. It returns
+  // the decrease in the sum of the weighted distances. The representatives for
+  // which the given point is nearest are assigned the index of the pick.
+  template<class Point>
+  double UpdateDistances(const mat& points, const rowvec& weights,
+                         uword num_points, const Point& point, uword pick) {
+    double decrease = 0;
+    for (uword counter = 0; counter < num_points; counter++) {
+      double distance = accu(square(points.col(counter) - point));
+      if (distance < min_distances[counter]) {
+        if (min_distances[counter] < numeric_limits<double>::infinity())
+          decrease += weights[counter] * (min_distances[counter] - distance);
+        min_distances[counter] = distance;
+        nearest[counter] = pick;
+      }
+    }
+    return decrease;
+  }
+
+  // Picks an index with probability proportional to the weights times the
+  // distances, whose sum is total. If the total is not positive, the index is
+  // picked uniformly. For the first pick, the distances are all infinite and
+  // are ignored, so that the total is that of the weights.
+  uword PickIndex(const rowvec& weights, uword num_points, double total,
+                  bool first) {
+    if (total <= 0)
+      return std::min<uword>(uniform_distribution(generator) * num_points,
+                             num_points - 1);
+    double random_weight = uniform_distribution(generator) * total;
+    uword choice;
+    for (choice = 0; choice < num_points - 1; choice++) {
+      random_weight -= first ? weights[choice]
+                             : weights[choice] * min_distances[choice];
+      if (random_weight < 0)
+        break;
+    }
+    return choice;
+  }
+
+  // Reduces the given representatives to at most kSize of them. First, k seeds
+  // are picked via weighted D^2 sampling, which is a bicriteria solution. The
+  // sensitivity of each representative is then bounded using its distance to
+  // the nearest seed and the weight and cost of that seed's cluster. kSize
+  // draws are made in proportion to the sensitivities and each representative
+  // drawn is weighted by the inverse of its probability. Lastly, the weights
+  // are scaled so that the total weight is unchanged.
+  void Reduce(mat& points, rowvec& weights) {
+    uword num_points = points.n_cols;
+    if (num_points <= kSize)
+      return;
+    min_distances.head(num_points).fill(numeric_limits<double>::infinity());
+    // The sum of the weighted distances, kept up to date as seeds are picked.
+    double total = accu(weights);
+    for (uword s_counter = 0; s_counter < <?=$numberClusters?>; s_counter++) {
+      uword pick = PickIndex(weights, num_points, total, s_counter == 0);
+      double decrease = UpdateDistances(points, weights, num_points,
+                                        points.col(pick), s_counter);
+      total = (s_counter == 0)
+          ? accu(weights % min_distances.head(num_points))
+          : total - decrease;
+    }
+
+    // The weight and cost of the cluster of each seed.
+    vec::fixed<<?=$numberClusters?>> cluster_weights(fill::zeros);
+    vec::fixed<<?=$numberClusters?>> cluster_costs(fill::zeros);
+    for (uword counter = 0; counter < num_points; counter++) {
+      cluster_weights[nearest[counter]] += weights[counter];
+      cluster_costs[nearest[counter]] += weights[counter] * min_distances[counter];
+    }
+    double total_weight = accu(cluster_weights);
+    double average_cost = accu(cluster_costs) / total_weight;
+
+    // The terms for the cost are dropped if every representative coincides
+    // with a seed, as only the weight of each cluster matters then.
+    for (uword counter = 0; counter < num_points; counter++) {
+      uword seed = nearest[counter];
+      double bound = 4 * total_weight / cluster_weights[seed];
+      if (average_cost > 0)
+        bound += <?=$alpha?> * (min_distances[counter]
+                                + 2 * cluster_costs[seed] / cluster_weights[seed])
+                 / average_cost;
+      sensitivities[counter] = weights[counter] * bound;
+    }
+
+    // The draws are made via a binary search on the cumulative sensitivities.
+    double* cumulative = sensitivities.memptr();
+    std::partial_sum(cumulative, cumulative + num_points, cumulative);
+    double total_sensitivity = cumulative[num_points - 1];
+    draws.head(num_points).zeros();
+    for (uword d_counter = 0; d_counter < kSize; d_counter++) {
+      double random_sensitivity
+          = uniform_distribution(generator) * total_sensitivity;
+      uword choice = std::upper_bound(cumulative, cumulative + num_points,
+                                      random_sensitivity) - cumulative;
+      draws[std::min(choice, num_points - 1)]++;
+    }
+
+    uvec picked = find(draws.head(num_points));
+    rowvec new_weights(picked.n_elem);
+    for (uword p_counter = 0; p_counter < picked.n_elem; p_counter++) {
+      uword index = picked[p_counter];
+      double sensitivity = cumulative[index]
+                         - (index == 0 ? 0 : cumulative[index - 1]);
+      new_weights[p_counter] = draws[index] * weights[index]
+                             * total_sensitivity / (kSize * sensitivity);
+    }
+    new_weights *= total_weight / accu(new_weights);
+    mat new_points = points.cols(picked);
+    points = std::move(new_points);
+    weights = std::move(new_weights);
+  }
+
+  // Gathers the buffer and the coresets of every level into points.
+  void Collect() {
+    uword total_size = size;
+    for (const mat& level : level_points)
+      total_size += level.n_cols;
+    points.set_size(<?=$numNumeric?>, total_size);
+    weights.set_size(total_size);
+    if (size > 0) {
+      points.head_cols(size) = buffer.head_cols(size);
+      weights.head(size).ones();
+    }
+    uword offset = size;
+    for (uword level = 0; level < level_points.size(); level++) {
+      uword num_points = level_points[level].n_cols;
+      if (num_points == 0)
+        continue;
+      points.cols(offset, offset + num_points - 1) = level_points[level];
+      weights.subvec(offset, offset + num_points - 1) = level_weights[level];
+      offset += num_points;
+    }
+  }
+
+  // Weighted k-means++ and then weighted Lloyd's algorithm are performed on the
+  // coreset. The data is never processed again, so this always returns false.
+  bool ShouldIterate(<?=$constantState?> & modible_state) {
+    Collect();
+    uword num_points = points.n_cols;
+    if (num_points == 0)
+      return false;
+    auto& centers = modible_state.centers;
+    min_distances.set_size(num_points);
+    nearest.set_size(num_points);
+    min_distances.fill(numeric_limits<double>::infinity());
+    double total = accu(weights);
+    for (uword c_counter = 0; c_counter < <?=$numberClusters?>; c_counter++) {
+      centers.col(c_counter)
+          = points.col(PickIndex(weights, num_points, total, c_counter == 0));
+      double decrease = UpdateDistances(points, weights, num_points,
+                                        centers.col(c_counter), c_counter);
+      total = (c_counter == 0) ? accu(weights % min_distances) : total - decrease;
+    }
+
+    mat::fixed<<?=$numNumeric?>, <?=$numberClusters?>> sums;
+    rowvec::fixed<<?=$numberClusters?>> counts;
+    rowvec::fixed<<?=$numberClusters?>> distances;
+    mat::fixed<<?=$numNumeric?>, <?=$numberClusters?>> shifted_centers;
+    uword index;
+    bool has_converged = false;
+    while (!has_converged && modible_state.iteration < <?=$maxIteration?>) {
+      sums.zeros();
+      counts.zeros();
+      total_score = 0;
+      for (uword counter = 0; counter < num_points; counter++) {
+        shifted_centers = centers;
+        shifted_centers.each_col() -= points.col(counter);
+        distances = sum(square(shifted_centers), 0);
+        total_score += weights[counter] * distances.min(index);
+        sums.col(index) += weights[counter] * points.col(counter);
+        counts[index] += weights[counter];
+      }
+      has_converged = true;
+      for (uword c_counter = 0; c_counter < <?=$numberClusters?>; c_counter++) {
+        if (counts[c_counter] == 0)
+          continue;
+        vec new_center = sums.col(c_counter) / counts[c_counter];
+        has_converged = has_converged
+            && max(abs(centers.col(c_counter) - new_center)) <= <?=$epsilon?>;
+        centers.col(c_counter) = new_center;
+      }
+      modible_state.iteration++;
+    }
+    return false;
+  }
+
+  void GetResult(<?=typed_ref_args($outputs)?>) {
+    long count = accu(weights);
+    long coreset_size = points.n_cols;
+<?= ProduceResult(array_keys($outputs)[0],
+                  ['centers'      => 'constant_state.centers',
+                   'iteration'    => 'constant_state.iteration',
+                   'total_score'  => 'total_score',
+                   'coreset_size' => 'coreset_size',
+                   'count'        => 'count']);?>
+  }
+};
+
+<?  return [
+        'kind'             => 'GLA',
+        'name'             => $className,
+        'system_headers'   => ['armadillo', 'string', 'iostream', 'limits',
+                               'random', 'algorithm', 'numeric', 'utility',
+                               'vector'],
+        'user_headers'     => [],
+        'lib_headers'      => ['ArmaJson'],
+        'iterable'         => TRUE,
+        'input'            => $inputs,
+        'output'           => $outputs,
+        'result_type'      => 'single',
+        'generated_state'  => $constantState,
+    ];
+} ?>
@@ -8,6 +8,9 @@ function K_Means_Constant_State(array $t_args)
     $numNumeric         = $t_args['numNumeric'];
     $initialCentersCode = $t_args['initialCentersCode'];
     $normalized         = $t_args['normalized'];
+    $pruned             = $t_args['pruned'];
+    $miniBatch          = $t_args['miniBatch'];
+    $kMeansParallel     = $t_args['kMeansParallel'];
 ?>
 using namespace arma;
 using namespace std;
@@ -25,20 +28,91 @@ class <?=$className?>ConstantState {
   // Only range and minimum are needed for the linear transformation.
   mat::fixed<<?=$numNumeric?>, 3> transformations;
 <?  } ?>
+<?  if ($pruned) { ?>
+
+  // The Euclidean distance between each pair of centers.
+  mat::fixed<<?=$numberClusters?>, <?=$numberClusters?>> center_distances;
+
+  // Half of the distance between each center and the center nearest to it. A
+  // point within this distance of a center cannot be closer to any other one.
+  rowvec::fixed<<?=$numberClusters?>> center_radii;
+<?  } ?>
+<?  if ($miniBatch) { ?>
+
+  // The total number of items assigned to each center across all mini-batches.
+  // The learning rate for a center is the reciprocal of this.
+  rowvec::fixed<<?=$numberClusters?>> center_counts;
+
+  // Whether the current pass is over the entire data and is only used to score
+  // the final centers.
+  bool final_pass;
+<?  } ?>
+<?  if ($kMeansParallel) { ?>
+
+  // The number of k-means|| passes completed after the first center was picked.
+  int init_pass;
+
+  // The candidate centers for k-means||, one per column. The number of these
+  // is not known beforehand.
+  mat candidates;
+
+  // The cost of the candidates, i.e. the sum of the squared distances between
+  // each point and its nearest candidate.
+  double init_cost;
+<?  } ?>
 
  public:
   friend class <?=$className?>;
 
   <?=$className?>ConstantState()
       : iteration(0),
+<?  if ($miniBatch) { ?>
+        centers(<?=$initialCentersCode?>),
+        center_counts(zeros<rowvec>(<?=$numberClusters?>)),
+<?      if ($kMeansParallel) { ?>
+        final_pass(false),
+        init_pass(0),
+        candidates(),
+        init_cost(0) {
+<?      } else { ?>
+        final_pass(false) {
+<?      } ?>
+<?  } else if ($kMeansParallel) { ?>
+        centers(<?=$initialCentersCode?>),
+        init_pass(0),
+        candidates(),
+        init_cost(0) {
+<?  } else { ?>
         centers(<?=$initialCentersCode?>) {
+<?  } ?>
+<?  if ($pruned) { ?>
+    UpdateCenterDistances();
+<?  } ?>
   }
+<?  if ($pruned) { ?>
+
+  // This must be called whenever the centers are changed.
+  void UpdateCenterDistances() {
+    for (uword i = 0; i < <?=$numberClusters?>; i++) {
+      center_distances(i, i) = 0;
+      for (uword j = 0; j < i; j++)
+        center_distances(i, j) = center_distances(j, i)
+                               = norm(centers.col(i) - centers.col(j), 2);
+    }
+    for (uword i = 0; i < <?=$numberClusters?>; i++) {
+      center_radii[i] = numeric_limits<double>::infinity();
+      for (uword j = 0; j < <?=$numberClusters?>; j++)
+        if (i != j)
+          center_radii[i] = std::min(center_radii[i], center_distances(i, j) / 2);
+    }
+  }
+<?  } ?>
 };
 <?
     return [
         'kind' => 'RESOURCE',
         'name' => $className . 'ConstantState',
-        'system_headers' => array('armadillo'),
+        'system_headers' => array('armadillo', 'limits'),
         'user_headers' => array(),
     ];
 }
@@ -65,6 +139,19 @@ function K_Means(array $t_args, array $inputs, array $outputs)
     $mFuzzifier = $t_args['m'];
     grokit_assert($mFuzzifier >= 1, "The parameter m must be at least one.");
 
+    // For fuzzy clustering, the weights are the distances raised to the power of
+    // -1 / (m - 1). When 1 / (m - 1) is a small integer or half-integer, this is
+    // computed with multiplications and a square root. Otherwise, a vectorized
+    // approximation of exp and log is used in place of pow.
+    if ($mFuzzifier > 1) {
+        $fuzzyPower = 1 / ($mFuzzifier - 1);
+        $fuzzyInteger = abs($fuzzyPower - round($fuzzyPower)) < 1e-12
+                     && round($fuzzyPower) <= 16;
+        $fuzzyHalf = !$fuzzyInteger
+                  && abs(2 * $fuzzyPower - round(2 * $fuzzyPower)) < 1e-12
+                  && round(2 * $fuzzyPower) <= 33;
+    }
+
     // The dimension of the data, i.e. how many elements are in each item.
     $dimension = count($inputs);
 
@@ -81,6 +168,66 @@ function K_Means(array $t_args, array $inputs, array $outputs)
     $convergence = $t_args['convergence'];
     $relativeConvergence = $convergence == "relative";
 
+    // The number of items buffered before they are assigned to clusters all at
+    // once. If positive, the squared Euclidean distances for an entire block are
+    // computed as |x|^2 - 2 * x^T * c + |c|^2, which reduces the bulk of the work
+    // to a single matrix multiplication. Otherwise, each item is processed as it
+    // is read in. Blocking is only supported for the Euclidean distance.
+    $blockSize = get_default($t_args, 'block.size', 0);
+    $blocked = $blockSize > 0;
+    grokit_assert(!$blocked || $pMinkowski == 2,
+                  "Blocked assignment requires p = 2.");
+
+    // Whether the triangle inequality is used to avoid computing the distance
+    // between an item and centers that cannot be closer than the best so far. A
+    // center c_j is skipped if d(c_best, c_j) >= 2 * d(x, c_best). The result is
+    // exact. This is only used for the Euclidean distance and hard clustering;
+    // otherwise, every distance is computed as usual.
+    $pruning = get_default($t_args, 'pruning', false);
+    grokit_assert(!($pruning && $blocked),
+                  "Pruning and blocked assignment cannot both be used.");
+    $pruned = $pruning && $pMinkowski == 2 && $mFuzzifier == 1;
+
+    // The precision used to assign items to clusters, either single or double.
+    // In single precision, the distances and the nearest center are computed by
+    // hand-vectorized kernels chosen at runtime for the CPU, which halves the
+    // memory traffic and doubles the SIMD lanes. The sums are still accumulated
+    // in double precision. This is only supported for the Euclidean distance
+    // and hard clustering.
+    $precision = get_default($t_args, 'precision', 'double');
+    grokit_assert(in_array($precision, ['single', 'double']),
+                  "The precision must be either single or double.");
+    $singlePrecision = $precision == 'single';
+    grokit_assert(!$singlePrecision || ($pMinkowski == 2 && $mFuzzifier == 1),
+                  "Single precision requires p = 2 and m = 1.");
+    grokit_assert(!$singlePrecision || !($blocked || $pruning),
+                  "Single precision cannot be used with blocking or pruning.");
+
+    // The probability with which each item is included in a mini-batch. If it
+    // is positive, each iteration only processes a Bernoulli sample of the data
+    // and the centers are updated as per Sculley's mini-batch k-means, in which
+    // each center has a learning rate equal to the reciprocal of the number of
+    // items assigned to it thus far. The first pass is still over the full data
+    // if it is used to pick centers or to normalize the data.
+    $batchFraction = get_default($t_args, 'batch.fraction', 0);
+    $miniBatch = $batchFraction > 0;
+    grokit_assert($batchFraction <= 1,
+                  "The batch fraction cannot be greater than one.");
+    grokit_assert(!$miniBatch || $mFuzzifier == 1,
+                  "Mini-batches are not supported for fuzzy clustering.");
+
+    // Whether a final pass over the entire data is performed after the
+    // mini-batches conclude. This pass leaves the centers untouched and only
+    // computes total_score, which is then reported.
+    $finalPass = $miniBatch && get_default($t_args, 'final.pass', true);
+
+    // For fuzzy clustering, the number of items whose weights are buffered before
+    // being added to the sums as a single rank-B update, rather than one rank-1
+    // update per item. This is unused for blocked assignment, which already
+    // performs a rank-B update per block.
+    $fuzzyBlock = get_default($t_args, 'fuzzy.block', 64);
+    $fuzzyBuffered = $mFuzzifier > 1 && !$blocked && $fuzzyBlock > 0;
+
     $input_types = array_values($inputs);
 
     // Checking if input is pre-vectorized.
@@ -104,6 +251,11 @@ function K_Means(array $t_args, array $inputs, array $outputs)
     if ($kMeansPP = ($t_args['centers'] == 'k-means++')) {
         $sampleSize = $t_args['sample.size'];
         $initialCentersCode = '';
+    // Or k-means|| is performed over the entire data. A single random item is
+    // sampled to be the first candidate.
+    } else if ($kMeansParallel = ($t_args['centers'] == 'k-means||')) {
+        $sampleSize = 1;
+        $initialCentersCode = '';
     // Or a random sample of size $numberClusters is used to pick centers.
     } else if ($standardStart = ($t_args['centers'] == 'standard')) {
         $sampleSize = $numberClusters;
@@ -132,14 +284,35 @@ function K_Means(array $t_args, array $inputs, array $outputs)
     /* $numNumeric = count($numeric); */
     /* $numFactors = count($factors); */
 
+    // The following are only used for k-means||, as described by Bahmani et al.
+    if ($kMeansParallel) {
+        // The expected number of candidates sampled in each round.
+        $oversampling = get_default($t_args, 'oversampling', 2 * $numberClusters);
+
+        // The number of sampling rounds, each of which is a pass over the data.
+        $rounds = get_default($t_args, 'rounds', 5);
+
+        // The number of iterations of weighted Lloyd's algorithm performed on the
+        // candidates after they are reduced to the initial centers by k-means++.
+        $reduceIterations = get_default($t_args, 'reduce.iterations', 10);
+
+        // Aside from the pass picking the first candidate, there is a pass that
+        // computes the cost of the first candidate, a pass for each round, and a
+        // pass that weights the candidates.
+        $initPasses = $rounds + 2;
+
+        grokit_assert($oversampling > 0, "The oversampling must be positive.");
+        grokit_assert($rounds > 0, "There must be at least one round.");
+    }
+
     $codeArray = array_combine(array_keys($inputs), range(0, $dimension - 1));
 
-    if ($kMeansPP || $standardStart) {
+    if ($kMeansPP || $standardStart || $kMeansParallel) {
         // The GLA for reservoir sampling is created.
         $samplingClass = lookupGLA(
             "statistics::Reservoir_Sampling",
-            array('threshold.coefficient' => 22,
-                  'sample.size'           => $sampleSize),
+            array('coefficient' => 22,
+                  'size'        => $sampleSize),
             $inputs,
             $inputs
         );
@@ -160,6 +333,9 @@ class <?=$className?>;
             'initialCentersCode' => $initialCentersCode,
             'numberClusters'     => $numberClusters,
             'normalized'         => $normalized,
+            'pruned'             => $pruned,
+            'miniBatch'          => $miniBatch,
+            'kMeansParallel'     => $kMeansParallel,
         )
     ); ?>
 
@@ -198,17 +374,94 @@ class <?=$className?> {
   // TODO: Implement a better measure, such as explained variance.
   double total_score;
 
-<?  if ($startsNeeded = ($kMeansPP || $standardStart)) {
+<?  if ($startsNeeded = ($kMeansPP || $standardStart || $kMeansParallel)) {
         if ($kMeansPP) { ?>
   // The reservoir sampling GLA that is used to construct the sample which
   // k-means++ will be performed on. k-means++ is performed on a sample because
   // it requires a lot of passes over the data, 2 * ($numberClusters - 1).
+<?      } else if ($kMeansParallel) { ?>
+  // The reservoir sampling GLA that is used to pick the first candidate for
+  // k-means||.
 <?      } else { ?>
   // The reservoir sampling GLA that is used to construct the sample which will
   // be used as the initial cluster centers.
 <?      } ?>
   <?=$samplingClass?> sampling_GLA;
 
+<?  } ?>
+<?  if ($blocked) { ?>
+  // The buffered items, one per column, that have yet to be assigned. These are
+  // dynamically allocated because a fixed matrix of this size would be too large.
+  mat block;
+
+  // The number of items currently in the block.
+  uword block_count;
+
+  // The squared distance between each center and each item in the block, with
+  // one row per center and one column per item.
+  mat block_distances;
+
+<?  } ?>
+<?  if ($fuzzyBuffered) { ?>
+  // The buffered items and their fuzzy weights, one item per column, that have
+  // yet to be added to the sums and counts.
+  mat fuzzy_items;
+  mat fuzzy_weights;
+
+  // The number of items currently buffered.
+  uword fuzzy_count;
+
+<?  } ?>
+<?  if ($kMeansParallel) { ?>
+  // The sum of the squared distances between each item and its nearest
+  // candidate for k-means||.
+  double init_cost;
+
+  // The items sampled as candidates by this state in the current round.
+  mat sampled;
+
+  // The number of items nearest to each candidate, used to weight them.
+  rowvec candidate_weights;
+
+  // Stores each candidate after the current item is subtracted from it.
+  mat shifted_candidates;
+
+  // The squared distance between the current item and each candidate.
+  rowvec candidate_distances;
+
+  // Used to decide whether the current item is sampled as a candidate.
+  std::uniform_real_distribution<double> uniform_distribution;
+
+<?  } ?>
+<?  if ($miniBatch) { ?>
+  // Decides whether each item is part of the current mini-batch. Each state has
+  // its own generator, so no synchronization is needed.
+  std::bernoulli_distribution batch_distribution;
+
+<?  } ?>
+<?  if ($miniBatch || $kMeansParallel) { ?>
+  // A random engine used to generate the above. Each state has its own.
+  std::default_random_engine generator;
+
+<?  } ?>
+<?  if ($singlePrecision) { ?>
+  // The kernel used to find the nearest center, chosen for the current CPU.
+  kmeans_kernels::NearestCenter nearest_center;
+
+  // The number of floats between consecutive coordinates in float_centers.
+  static const constexpr std::size_t kStride
+      = kmeans_kernels::Stride(<?=$numberClusters?>);
+
+  // The centers in single precision. These are stored dimension-major, as is
+  // required by the kernel, and converted once per pass.
+  std::vector<float> float_centers;
+
+  // The current item in single precision.
+  std::vector<float> float_item;
+
+  // The distance between the current item and each center.
+  std::vector<float> float_distances;
+
 <?  } ?>
   // These three variables are used in AddItem to fully utilize Armadillo:
 
@@ -246,6 +499,36 @@ class <?=$className?> {
 <?  if ($startsNeeded) { ?>
         sampling_GLA(),
 <?  } ?>
+<?  if ($blocked) { ?>
+        block(<?=$numNumeric?>, <?=$blockSize?>),
+        block_count(0),
+        block_distances(<?=$numberClusters?>, <?=$blockSize?>),
+<?  } ?>
+<?  if ($fuzzyBuffered) { ?>
+        fuzzy_items(<?=$numNumeric?>, <?=$fuzzyBlock?>),
+        fuzzy_weights(<?=$numberClusters?>, <?=$fuzzyBlock?>),
+        fuzzy_count(0),
+<?  } ?>
+<?  if ($kMeansParallel) { ?>
+        init_cost(0),
+        sampled(<?=$numNumeric?>, 0),
+        candidate_weights(zeros<rowvec>(state.candidates.n_cols)),
+        shifted_candidates(),
+        candidate_distances(),
+        uniform_distribution(0.0, 1.0),
+<?  } ?>
+<?  if ($miniBatch) { ?>
+        batch_distribution(<?=$batchFraction?>),
+<?  } ?>
+<?  if ($miniBatch || $kMeansParallel) { ?>
+        generator(std::random_device()() + id),
+<?  } ?>
+<?  if ($singlePrecision) { ?>
+        nearest_center(kmeans_kernels::SelectNearestCenter()),
+        float_centers(<?=$numNumeric?> * kStride, 0),
+        float_item(<?=$numNumeric?>),
+        float_distances(kStride),
+<?  } ?>
 <?  if ($mFuzzifier > 1) { ?>
         distance_sum(0),
 <?  } else { ?>
@@ -256,11 +539,30 @@ class <?=$className?> {
 <?  if ($normalized) { ?>
     transformations.col(0).fill(-numeric_limits<double>::infinity());
     transformations.col(1).fill( numeric_limits<double>::infinity());
+<?  } ?>
+<?  if ($singlePrecision) { ?>
+    for (uword row = 0; row < <?=$numNumeric?>; row++)
+      for (uword col = 0; col < <?=$numberClusters?>; col++)
+        float_centers[row * kStride + col] = state.centers(row, col);
 <?  } ?>
   }
 
   void AddItem(<?=const_typed_ref_args($inputs)?>) {
     // TODO: Add diagonistic statistics to see how good the fit is.
+<?  if ($miniBatch) { ?>
+    // Items not in the current mini-batch are skipped before being processed.
+<?      if ($kMeansParallel) { ?>
+    if (constant_state.iteration > 0
+        && constant_state.init_pass == <?=$initPasses?>
+        && !constant_state.final_pass && !batch_distribution(generator))
+<?      } else if ($startsNeeded || $normalized) { ?>
+    if (constant_state.iteration > 0 && !constant_state.final_pass
+        && !batch_distribution(generator))
+<?      } else { ?>
+    if (!constant_state.final_pass && !batch_distribution(generator))
+<?      } ?>
+      return;
+<?  } ?>
 <?  if ($vectorized) { ?>
     item = vec(<?=array_keys($inputs)[0]?>.data(), <?=$numNumeric?>);
 <?  } else { ?>
@@ -289,6 +591,47 @@ class <?=$className?> {
     item -= constant_state.transformations.col(1);
     item /= constant_state.transformations.col(2);
 <?  } ?>
+<?  if ($kMeansParallel) { ?>
+    if (constant_state.init_pass < <?=$initPasses?>) {
+      AddCandidateItem();
+      return;
+    }
+<?  } ?>
+<?  if ($blocked) { ?>
+    block.col(block_count++) = item;
+    if (block_count == <?=$blockSize?>)
+      FlushBlock();
+<?  } else if ($pruned) { ?>
+    // Squared distances are used for comparisons, whereas the bounds use the
+    // actual distance to the best center found so far.
+    index = 0;
+    double best = accu(square(constant_state.centers.col(0) - item));
+    double radius = sqrt(best);
+    for (uword counter = 1; counter < <?=$numberClusters?>; counter++) {
+      if (radius <= constant_state.center_radii[index])
+        break;
+      if (constant_state.center_distances(index, counter) >= 2 * radius)
+        continue;
+      double distance = accu(square(constant_state.centers.col(counter) - item));
+      if (distance < best) {
+        best = distance;
+        radius = sqrt(best);
+        index = counter;
+      }
+    }
+    total_score += best;
+    sums.col(index) += item;
+    counts[index] ++;
+<?  } else if ($singlePrecision) { ?>
+    for (uword counter = 0; counter < <?=$numNumeric?>; counter++)
+      float_item[counter] = item[counter];
+    index = nearest_center(float_item.data(), float_centers.data(),
+                           <?=$numNumeric?>, <?=$numberClusters?>, kStride,
+                           float_distances.data());
+    total_score += float_distances[index];
+    sums.col(index) += item;
+    counts[index] ++;
+<?  } else { ?>
     shifted_centers = constant_state.centers;
     shifted_centers.each_col() -= item;
 <?  if ($pMinkowski % 2 != 0) { ?>
@@ -326,10 +669,17 @@ class <?=$className?> {
     }
 <?      }
     } else { ?>
-    distances = pow(distances + 0.000000001, <?= -1 / ($mFuzzifier - 1) ?>);
+    FuzzyWeights(distances.memptr(), <?=$numberClusters?>);
     distances /= sum(distances);
+<?      if ($fuzzyBuffered) { ?>
+    fuzzy_items.col(fuzzy_count) = item;
+    fuzzy_weights.col(fuzzy_count) = distances.t();
+    if (++fuzzy_count == <?=$fuzzyBlock?>)
+      FlushFuzzy();
+<?      } else { ?>
     counts += distances;
     sums   += item * distances;
+<?      } ?>
 <?      if ($debug) { ?>
     if (id == 0 && (sum(counts) <= 10 || sum(counts) == 20000000)) {
       cout << "Item number: " << sum(counts) << endl;
@@ -340,10 +690,171 @@ class <?=$className?> {
     }
 <?      }
     } ?>
+<?  } ?>
     // if (any(item < 0))
     //   cout << "Negative item:" << endl << item << endl;
   }
+<?  if ($blocked) { ?>
+
+  // Assigns every item in the block to the clusters at once. The distances are
+  // expanded so that the cross terms are a single matrix product; this loses
+  // some precision for data far from the origin, which normalization alleviates.
+  void FlushBlock() {
+    if (block_count == 0)
+      return;
+    auto points = block.head_cols(block_count);
+    block_distances = constant_state.centers.t() * points;
+    block_distances *= -2;
+    block_distances.each_row() += sum(square(points), 0);
+    block_distances.each_col() += trans(sum(square(constant_state.centers), 0));
+    // Rounding can cause slightly negative distances for points on a center.
+    block_distances = clamp(block_distances, 0, datum::inf);
+<?      if ($mFuzzifier == 1) { ?>
+    for (uword counter = 0; counter < block_count; counter++) {
+      total_score += block_distances.col(counter).min(index);
+      sums.col(index) += points.col(counter);
+      counts[index] ++;
+    }
+<?      } else { ?>
+    FuzzyWeights(block_distances.memptr(), block_distances.n_elem);
+    block_distances.each_row() /= sum(block_distances, 0);
+    counts += trans(sum(block_distances, 1));
+    sums   += points * block_distances.t();
+<?      } ?>
+    block_count = 0;
+  }
+<?  } ?>
+<?  if ($mFuzzifier > 1) { ?>
+
+  // Replaces each distance with its fuzzy weight prior to normalization, i.e.
+  // the distance raised to the power of -1 / (m - 1). A small offset is added
+  // to avoid dividing by zero.
+  void FuzzyWeights(double* values, uword num_values) {
+<?      if ($fuzzyInteger || $fuzzyHalf) {
+            $factors = array_fill(0, floor($fuzzyPower), 'inverse');
+            if ($fuzzyHalf)
+                $factors[] = 'sqrt(inverse)'; ?>
+    for (uword counter = 0; counter < num_values; counter++) {
+      double inverse = 1 / (values[counter] + 0.000000001);
+      values[counter] = <?=implode(' * ', $factors)?>;
+    }
+<?      } else { ?>
+    for (uword counter = 0; counter < num_values; counter++)
+      values[counter] += 0.000000001;
+    vector_math::Pow(values, <?=-$fuzzyPower?>, values, num_values);
+<?      } ?>
+  }
+<?  } ?>
+<?  if ($fuzzyBuffered) { ?>
+
+  // Adds the buffered items to the sums using a single matrix product.
+  void FlushFuzzy() {
+    if (fuzzy_count == 0)
+      return;
+    counts += trans(sum(fuzzy_weights.head_cols(fuzzy_count), 1));
+    sums   += fuzzy_items.head_cols(fuzzy_count)
+            * fuzzy_weights.head_cols(fuzzy_count).t();
+    fuzzy_count = 0;
+  }
+<?  } ?>
+
+<?  if ($kMeansParallel) { ?>
+  // Computes the squared distance between the current item and each candidate.
+  // The index of the nearest candidate is returned.
+  uword ComputeCandidateDistances(const mat& candidates) {
+    shifted_candidates = candidates;
+    shifted_candidates.each_col() -= item;
+<?      if ($pMinkowski == 2) { ?>
+    candidate_distances = sum(square(shifted_candidates), 0);
+<?      } else { ?>
+    candidate_distances = pow(sum(pow(abs(shifted_candidates), <?=$pMinkowski?>), 0),
+                              <?=2 / $pMinkowski?>);
+<?      } ?>
+    uword nearest;
+    candidate_distances.min(nearest);
+    return nearest;
+  }
+
+  // Processes the current item during the passes of k-means||. The first pass
+  // only computes the cost of the first candidate. Each round then samples each
+  // item with probability proportional to its squared distance to the nearest
+  // candidate. The cost that normalizes the probabilities is that of the
+  // previous round's candidates rather than the current ones; this is an upper
+  // bound that costs slightly fewer candidates per round but avoids a separate
+  // pass to compute the cost. The last pass weights each candidate.
+  void AddCandidateItem() {
+    uword nearest = ComputeCandidateDistances(constant_state.candidates);
+    double distance = candidate_distances[nearest];
+    if (constant_state.init_pass == <?=$initPasses - 1?>) {
+      candidate_weights[nearest]++;
+      return;
+    }
+    init_cost += distance;
+    if (constant_state.init_pass > 0 && constant_state.init_cost > 0) {
+      double probability = <?=$oversampling?> * distance / constant_state.init_cost;
+      if (uniform_distribution(generator) < probability)
+        sampled.insert_cols(sampled.n_cols, item);
+    }
+  }
+
+  // Reduces the weighted candidates to the initial centers. This is done by
+  // weighted k-means++ followed by weighted Lloyd's algorithm, both of which
+  // are performed in memory as there are relatively few candidates.
+  void ReduceCandidates(<?=$constantState?> & modible_state) {
+    const mat& points = modible_state.candidates;
+    uword num_points = points.n_cols;
+
+    // The squared distance between each candidate and its nearest center.
+    rowvec min_distances(num_points);
+    min_distances.fill(numeric_limits<double>::infinity());
+
+    // The probability of each candidate being picked is proportional to this.
+    rowvec probabilities(num_points);
+
+    std::uniform_int_distribution<uword> random_index(0, num_points - 1);
+
+    for (uword c_counter = 0; c_counter < <?=$numberClusters?>; c_counter++) {
+      if (c_counter == 0)
+        probabilities = candidate_weights;
+      else
+        probabilities = candidate_weights % min_distances;
+      double total = accu(probabilities);
+      uword choice;
+      if (total > 0) {
+        double random_weight = uniform_distribution(generator) * total;
+        for (choice = 0; choice < num_points - 1; choice++) {
+          random_weight -= probabilities[choice];
+          if (random_weight < 0)
+            break;
+        }
+      } else {
+        choice = random_index(generator);
+      }
+      modible_state.centers.col(c_counter) = points.col(choice);
+      item = points.col(choice);
+      ComputeCandidateDistances(points);
+      min_distances = arma::min(min_distances, candidate_distances);
+    }
 
+    mat::fixed<<?=$numNumeric?>, <?=$numberClusters?>> weighted_sums;
+    rowvec::fixed<<?=$numberClusters?>> weights;
+    for (int iteration = 0; iteration < <?=$reduceIterations?>; iteration++) {
+      weighted_sums.zeros();
+      weights.zeros();
+      for (uword p_counter = 0; p_counter < num_points; p_counter++) {
+        item = points.col(p_counter);
+        uword nearest = ComputeCandidateDistances(modible_state.centers);
+        weighted_sums.col(nearest) += candidate_weights[p_counter] * item;
+        weights[nearest] += candidate_weights[p_counter];
+      }
+      for (uword c_counter = 0; c_counter < <?=$numberClusters?>; c_counter++)
+        if (weights[c_counter] > 0)
+          modible_state.centers.col(c_counter)
+              = weighted_sums.col(c_counter) / weights[c_counter];
+    }
+  }
+
+<?  } ?>
   void AddState(<?=$className?> & other) {
 <?  if ($startsNeeded) { ?>
     // The other GLA must have the same state as this one, so there is no need
@@ -352,6 +863,22 @@ class <?=$className?> {
       sampling_GLA.AddState(other.sampling_GLA);
       return;
     }
+<?  }
+    if ($kMeansParallel) { ?>
+    if (constant_state.init_pass < <?=$initPasses?>) {
+      init_cost += other.init_cost;
+      sampled.insert_cols(sampled.n_cols, other.sampled);
+      candidate_weights += other.candidate_weights;
+      return;
+    }
+<?  }
+    if ($blocked) { ?>
+    FlushBlock();
+    other.FlushBlock();
+<?  }
+    if ($fuzzyBuffered) { ?>
+    FlushFuzzy();
+    other.FlushFuzzy();
 <?  }
     if ($debug) { ?>
     if (id == 0) {
@@ -361,6 +888,7 @@ class <?=$className?> {
 <?  } ?>
     sums   += other.sums;
     counts += other.counts;
+    total_score += other.total_score;
 <?  if ($debug) { ?>
     if (id == 0) {
       cout << "After Sums:" << endl << sums << endl;
@@ -371,6 +899,13 @@ class <?=$className?> {
 
   bool ShouldIterate(<?=$constantState?> & modible_state) {
     next_id.store(0);  // Used for debugging purposes. Can be ignored.
+<?  if ($blocked) { ?>
+    // The final state may never have been merged, so its block is emptied here.
+    FlushBlock();
+<?  } ?>
+<?  if ($fuzzyBuffered) { ?>
+    FlushFuzzy();
+<?  } ?>
 <?  if ($normalized) { ?>
     if (constant_state.iteration == 0) {
       transformations.col(2) = transformations.col(0) - transformations.col(1);
@@ -378,6 +913,9 @@ class <?=$className?> {
 <?      if (!$startsNeeded) { ?>
       modible_state.centers.each_col() -= transformations.col(1);
       modible_state.centers.each_col() /= transformations.col(2);
+<?          if ($pruned) { ?>
+      modible_state.UpdateCenterDistances();
+<?          } ?>
       modible_state.iteration++;
       return;
 <?      } ?>
@@ -480,6 +1018,9 @@ class <?=$className?> {
 <?          if ($normalized) { ?>
       modible_state.centers.each_col() -= transformations.col(1);
       modible_state.centers.each_col() /= transformations.col(2);
+<?          } ?>
+<?          if ($pruned) { ?>
+      modible_state.UpdateCenterDistances();
 <?          } ?>
       return true;
 <?      } else if ($standardStart) { ?>
@@ -489,18 +1030,72 @@ class <?=$className?> {
 <?          if ($normalized) { ?>
       modible_state.centers.each_col() -= transformations.col(1);
       modible_state.centers.each_col() /= transformations.col(2);
+<?          } ?>
+<?          if ($pruned) { ?>
+      modible_state.UpdateCenterDistances();
 <?          } ?>
       return true;
+<?      } else if ($kMeansParallel) { ?>
+      modible_state.candidates = sample.col(0);
+<?          if ($normalized) { ?>
+      modible_state.candidates -= transformations.col(1);
+      modible_state.candidates /= transformations.col(2);
+<?          } ?>
+      modible_state.iteration++;
+      return true;
 <?      } ?>
     }
 
 
+<?  } ?>
+<?  if ($kMeansParallel) { ?>
+    if (constant_state.init_pass < <?=$initPasses?>) {
+      if (constant_state.init_pass == <?=$initPasses - 1?>) {
+        ReduceCandidates(modible_state);
+<?      if ($pruned) { ?>
+        modible_state.UpdateCenterDistances();
+<?      } ?>
+        // The candidates are no longer needed.
+        modible_state.candidates.reset();
+      } else {
+        modible_state.init_cost = init_cost;
+        modible_state.candidates.insert_cols(modible_state.candidates.n_cols,
+                                             sampled);
+      }
+<?      if ($debug) { ?>
+      cout << "k-means|| pass " << modible_state.init_pass << ": "
+           << modible_state.candidates.n_cols << " candidates" << endl;
+<?      } ?>
+      modible_state.init_pass++;
+      return true;
+    }
+<?  } ?>
+<?  if ($finalPass) { ?>
+    // The final pass only scores the centers, which are left as they are.
+    if (constant_state.final_pass) {
+<?      if ($normalized) { ?>
+      modible_state.centers.each_col() %= modible_state.transformations.col(2);
+      modible_state.centers.each_col() += modible_state.transformations.col(1);
+<?      } ?>
+      return false;
+    }
 <?  } ?>
     bool has_converged = true;
     vec new_center(<?=$numNumeric?>);
     for (int counter = 0; counter < <?=$numberClusters?>; counter++) {
+<?  if ($miniBatch) { ?>
+      // This is equivalent to Sculley's update being applied to each item in
+      // the batch in turn, as every item was assigned using the same centers.
+      if (counts[counter] > 0) {
+        modible_state.center_counts[counter] += counts[counter];
+        double rate = counts[counter] / modible_state.center_counts[counter];
+        new_center = (1 - rate) * modible_state.centers.col(counter)
+                   + rate * sums.col(counter) / counts[counter];
+      }
+<?  } else { ?>
       if (counts[counter] > 0)
         new_center = sums.col(counter) / counts[counter];
+<?  } ?>
       else
         new_center = modible_state.centers.col(counter);
       has_converged  = has_converged
@@ -508,7 +1103,16 @@ class <?=$className?> {
                                     new_center);
       modible_state.centers.col(counter) = new_center;
     }
+<?  if ($pruned) { ?>
+    modible_state.UpdateCenterDistances();
+<?  } ?>
     modible_state.iteration ++;
+<?  if ($finalPass) { ?>
+    if (has_converged || modible_state.iteration == <?=$maxIteration?>) {
+      modible_state.final_pass = true;
+      return true;
+    }
+<?  } ?>
 <?  if ($normalized) { ?>
     if (has_converged || modible_state.iteration == <?=$maxIteration?>) {
       modible_state.centers.each_col() %= modible_state.transformations.col(2);
@@ -544,9 +1148,11 @@ class <?=$className?> {
 <?  }  ?>
     // }
     // cout << result << endl;
-<?= ProduceResult(array_keys($outputs)[0],
-                  ['centers'   => 'constant_state.centers',
-                   'iteration' => 'constant_state.iteration']);?>
+<?  $result = ['centers'   => 'constant_state.centers',
+                'iteration' => 'constant_state.iteration'];
+    if ($finalPass)
+        $result['total_score'] = 'total_score'; ?>
+<?= ProduceResult(array_keys($outputs)[0], $result);?>
   }
 };
 
@@ -556,9 +1162,10 @@ std::atomic<int> <?=$className?>::next_id(0);
 <?  return [
         'kind'             => 'GLA',
         'name'             => $className,
-        'system_headers'   => ['armadillo', 'string', 'iostream', 'limits'],
+        'system_headers'   => ['armadillo', 'string', 'iostream', 'limits',
+                               'random', 'vector'],
         'user_headers'     => [],
-        'lib_headers'      => ['ArmaJson'],
+        'lib_headers'      => ['ArmaJson', 'kmeansKernels', 'vectorMath'],
         'iterable'         => TRUE,
         'input'            => $inputs,
         'output'           => $outputs,
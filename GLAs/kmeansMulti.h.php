@@ -0,0 +1,402 @@
+<?
+// This GLA fits several independent k-means models using the same passes over
+// the data. Each model has its own number of clusters and its own random start,
+// which allows for both choosing the number of clusters and multiple restarts
+// without scanning the data for each one. This is done via the following:
+// 1. The centers of every model are concatenated into a single matrix.
+// 2. Items are decoded once and buffered into a block.
+// 3. The squared Euclidean distances between the block and every center are
+//    computed as |x|^2 - 2 * x^T * c + |c|^2 via a single matrix product.
+// 4. Each model's accumulators are updated from its own rows of the distances.
+// A model stops accumulating once it has converged.
+
+// Template Args:
+// number.clusters: Either a single number of clusters or a list of them.
+// restarts:        The number of models fit for each number of clusters.
+// centers:         Either 'standard' or 'k-means++'. Each model picks its own
+//   initial centers from a shared random sample of the data.
+// sample.size:     The size of the sample used to pick initial centers.
+// block.size:      The number of items in each block.
+// max.iteration:   The maximum number of iterations.
+// epsilon:         The maximum change in a center allowed for convergence.
+function K_Means_Multi_Constant_State(array $t_args)
+{
+    // Grabbing variables from $t_args
+    $className     = $t_args['className'];
+    $numNumeric    = $t_args['numNumeric'];
+    $totalClusters = $t_args['totalClusters'];
+    $numberModels  = $t_args['numberModels'];
+?>
+using namespace arma;
+using namespace std;
+
+class <?=$className?>ConstantState {
+ private:
+  // The current iteration which is to be compared to $maxIteration.
+  long iteration;
+
+  // The centers of every model, concatenated. The centers of each model are
+  // contiguous and in the same order as the models.
+  mat::fixed<<?=$numNumeric?>, <?=$totalClusters?>> centers;
+
+  // Whether each model has converged.
+  urowvec::fixed<<?=$numberModels?>> converged;
+
+  // The number of iterations performed for each model.
+  urowvec::fixed<<?=$numberModels?>> iterations;
+
+ public:
+  friend class <?=$className?>;
+
+  <?=$className?>ConstantState()
+      : iteration(0),
+        centers(),
+        converged(zeros<urowvec>(<?=$numberModels?>)),
+        iterations(zeros<urowvec>(<?=$numberModels?>)) {
+  }
+};
+<?
+    return [
+        'kind' => 'RESOURCE',
+        'name' => $className . 'ConstantState',
+        'system_headers' => array('armadillo'),
+        'user_headers' => array(),
+    ];
+}
+
+function K_Means_Multi(array $t_args, array $inputs, array $outputs)
+{
+    // Class name is randomly generated
+    $className = generate_name("KMMulti");
+
+    // Setting output type
+    $outputs = ['_output' => lookupType('JSON')];
+
+    // Processing of template arguments
+    $numberClusters = $t_args['number.clusters'];
+    if (!is_array($numberClusters))
+        $numberClusters = [$numberClusters];
+    $restarts     = get_default($t_args, 'restarts', 1);
+    $centers      = get_default($t_args, 'centers', 'standard');
+    $blockSize    = get_default($t_args, 'block.size', 256);
+    $maxIteration = get_default($t_args, 'max.iteration', 20);
+    $epsilon      = get_default($t_args, 'epsilon', 0);
+    $debug        = get_default($t_args, 'debug', 0);
+
+    grokit_assert($restarts > 0, "There must be at least one restart.");
+    grokit_assert($blockSize > 0, "The block size must be positive.");
+    grokit_assert(in_array($centers, ['standard', 'k-means++']),
+                  "Incorrect specification for centers.");
+    $kMeansPP = $centers == 'k-means++';
+
+    // The number of clusters for each model and the index of its first center
+    // within the concatenated centers.
+    $modelClusters = [];
+    $offsets = [];
+    $totalClusters = 0;
+    foreach ($numberClusters as $clusters) {
+        grokit_assert($clusters > 0, "The number of clusters must be positive.");
+        for ($counter = 0; $counter < $restarts; $counter++) {
+            $modelClusters[] = $clusters;
+            $offsets[] = $totalClusters;
+            $totalClusters += $clusters;
+        }
+    }
+    $numberModels = count($modelClusters);
+    $maxClusters = max($modelClusters);
+
+    // Each model picks its centers from the same sample, which must therefore
+    // have at least as many items as the largest model has clusters.
+    $sampleSize = get_default($t_args, 'sample.size', $maxClusters);
+    grokit_assert($sampleSize >= $maxClusters,
+                  "The sample size must be at least the number of clusters.");
+
+    // The dimension of the data, i.e. how many elements are in each item.
+    $dimension = count($inputs);
+
+    $input_types = array_values($inputs);
+
+    // Checking if input is pre-vectorized.
+    if ($dimension == 1 && $input_types[0]->is("array")) {
+        grokit_assert($input_types[0]->get("type")->is("numeric"),
+                      "Non-numeric input given.");
+        $vectorized = true;
+        $numNumeric = $input_types[0]->get("size");
+    } else {
+        foreach ($inputs as $input)
+            grokit_assert($input->is("numeric"), "Non-numeric input given.");
+        $numNumeric = $dimension;
+        $vectorized = false;
+    }
+
+    $codeArray = array_combine(array_keys($inputs), range(0, $dimension - 1));
+
+    // The GLA for reservoir sampling is created.
+    $samplingClass = lookupGLA(
+        "statistics::Reservoir_Sampling",
+        array('coefficient' => 22,
+              'size'        => $sampleSize),
+        $inputs,
+        $inputs
+    );
+?>
+
+using namespace arma;
+using namespace std;
+
+class <?=$className?>;
+
+<?  $constantState = lookupResource(
+        "statistics::K_Means_Multi_Constant_State",
+        array(
+            'className'     => $className,
+            'numNumeric'    => $numNumeric,
+            'totalClusters' => $totalClusters,
+            'numberModels'  => $numberModels,
+        )
+    ); ?>
+
+class <?=$className?> {
+ private:
+  // The typical constant state for an iterable GLA.
+  const <?=$constantState?> & constant_state;
+
+  // A matrix where each column is the sum of the points in the corresponding
+  // cluster, using the same layout as the concatenated centers.
+  mat::fixed<<?=$numNumeric?>, <?=$totalClusters?>> sums;
+
+  // The number of items in each cluster.
+  rowvec::fixed<<?=$totalClusters?>> counts;
+
+  // The sum of the squared distances between each point and its nearest
+  // cluster center, for each model.
+  rowvec::fixed<<?=$numberModels?>> scores;
+
+  // The reservoir sampling GLA that is used to construct the sample from which
+  // each model picks its initial centers.
+  <?=$samplingClass?> sampling_GLA;
+
+  // The buffered items, one per column, that have yet to be assigned.
+  mat block;
+
+  // The number of items currently in the block.
+  uword block_count;
+
+  // The squared distance between each center and each item in the block, with
+  // one row per center and one column per item.
+  mat block_distances;
+
+  // The index of the closest cluster center within a model.
+  uword index;
+
+ public:
+  <?=$className?>(const <?=$constantState?> & state)
+      : constant_state(state),
+        sums(zeros<mat>(<?=$numNumeric?>, <?=$totalClusters?>)),
+        counts(zeros<rowvec>(<?=$totalClusters?>)),
+        scores(zeros<rowvec>(<?=$numberModels?>)),
+        sampling_GLA(),
+        block(<?=$numNumeric?>, <?=$blockSize?>),
+        block_count(0),
+        block_distances(<?=$totalClusters?>, <?=$blockSize?>),
+        index(0) {
+  }
+
+  void AddItem(<?=const_typed_ref_args($inputs)?>) {
+    if (constant_state.iteration == 0) {
+      sampling_GLA.AddItem(<?=args($inputs)?>);
+      return;
+    }
+<?  if ($vectorized) { ?>
+    block.col(block_count++)
+        = vec(<?=array_keys($inputs)[0]?>.data(), <?=$numNumeric?>);
+<?  } else { ?>
+<?      foreach ($codeArray as $name => $counter) { ?>
+    block(<?=$counter?>, block_count) = <?=$name?>;
+<?      } ?>
+    block_count++;
+<?  } ?>
+    if (block_count == <?=$blockSize?>)
+      FlushBlock();
+  }
+
+  // Assigns every item in the block to a cluster for each model. The distances
+  // to every center are computed at once, regardless of convergence, because
+  // the scores are still reported for converged models.
+  void FlushBlock() {
+    if (block_count == 0)
+      return;
+    auto points = block.head_cols(block_count);
+    block_distances = constant_state.centers.t() * points;
+    block_distances *= -2;
+    block_distances.each_row() += sum(square(points), 0);
+    block_distances.each_col() += trans(sum(square(constant_state.centers), 0));
+    // Rounding can cause slightly negative distances for points on a center.
+    block_distances = clamp(block_distances, 0, datum::inf);
+    for (uword counter = 0; counter < block_count; counter++) {
+<?  foreach ($modelClusters as $model => $clusters) {
+        $offset = $offsets[$model]; ?>
+      scores[<?=$model?>] += block_distances.col(counter)
+          .subvec(<?=$offset?>, <?=$offset + $clusters - 1?>).min(index);
+      if (!constant_state.converged[<?=$model?>]) {
+        sums.col(<?=$offset?> + index) += points.col(counter);
+        counts[<?=$offset?> + index] ++;
+      }
+<?  } ?>
+    }
+    block_count = 0;
+  }
+
+  void AddState(<?=$className?> & other) {
+    if (constant_state.iteration == 0) {
+      sampling_GLA.AddState(other.sampling_GLA);
+      return;
+    }
+    FlushBlock();
+    other.FlushBlock();
+    sums   += other.sums;
+    counts += other.counts;
+    scores += other.scores;
+  }
+
+  bool ShouldIterate(<?=$constantState?> & modible_state) {
+    // The final state may never have been merged, so its block is emptied here.
+    FlushBlock();
+    if (constant_state.iteration == 0) {
+      InitializeCenters(modible_state);
+      modible_state.iteration++;
+      return true;
+    }
+
+    bool any_active = false;
+    vec new_center(<?=$numNumeric?>);
+<?  foreach ($modelClusters as $model => $clusters) {
+        $offset = $offsets[$model]; ?>
+    if (!modible_state.converged[<?=$model?>]) {
+      bool has_converged = true;
+      for (uword counter = <?=$offset?>; counter < <?=$offset + $clusters?>; counter++) {
+        if (counts[counter] > 0)
+          new_center = sums.col(counter) / counts[counter];
+        else
+          new_center = modible_state.centers.col(counter);
+        has_converged = has_converged
+            && max(abs(modible_state.centers.col(counter) - new_center)) <= <?=$epsilon?>;
+        modible_state.centers.col(counter) = new_center;
+      }
+      modible_state.iterations[<?=$model?>]++;
+      modible_state.converged[<?=$model?>] = has_converged;
+      any_active = any_active || !has_converged;
+    }
+<?  } ?>
+    modible_state.iteration++;
+<?  if ($debug) { ?>
+    cout << "iteration: " << modible_state.iteration << endl;
+    cout << "converged: " << modible_state.converged << endl;
+    cout << "scores: " << scores << endl;
+<?  } ?>
+    return any_active && modible_state.iteration < <?=$maxIteration?>;
+  }
+
+  // Each model picks its own initial centers from the shared sample, using its
+  // own random draws so that restarts with the same number of clusters differ.
+  void InitializeCenters(<?=$constantState?> & modible_state) {
+    uword sample_size = sampling_GLA.GetSize();
+    mat sample(<?=$numNumeric?>, sample_size);
+    for (uword counter = 0; counter < sample_size; counter ++) {
+<?  if ($vectorized) { ?>
+      sample.col(counter) =
+          vec(get<0>(sampling_GLA.GetSample(counter)).data(), <?=$numNumeric?>);
+<?  } else { ?>
+<?      foreach (range(0, $dimension - 1) as $counter) { ?>
+      sample(<?=$counter?>, counter) = get<<?=$counter?>>(sampling_GLA.GetSample(counter));
+<?      } ?>
+<?  } ?>
+    }
+
+    // A random engine used to generate random variates.
+    std::default_random_engine generator(std::random_device()());
+<?  if ($kMeansPP) { ?>
+
+    // Used to perform weighted sampling for k-means++.
+    std::uniform_real_distribution<double> uniform_distribution(0.0, 1.0);
+
+    // The squared distance between each sampled item and its nearest center.
+    rowvec min_distances(sample_size);
+<?  } else { ?>
+
+    // The order in which the sampled items are used as centers.
+    std::vector<uword> order(sample_size);
+<?  } ?>
+
+<?  foreach ($modelClusters as $model => $clusters) {
+        $offset = $offsets[$model]; ?>
+<?      if ($kMeansPP) { ?>
+    min_distances.fill(numeric_limits<double>::infinity());
+    for (uword counter = 0; counter < <?=$clusters?>; counter++) {
+      double total = (counter == 0) ? sample_size : accu(min_distances);
+      double random_distance = uniform_distribution(generator) * total;
+      uword choice;
+      for (choice = 0; choice < sample_size - 1; choice++) {
+        random_distance -= (counter == 0) ? 1 : min_distances[choice];
+        if (random_distance < 0)
+          break;
+      }
+      modible_state.centers.col(<?=$offset?> + counter) = sample.col(choice);
+      mat shifted_sample = sample;
+      shifted_sample.each_col() -= sample.col(choice);
+      min_distances = arma::min(min_distances, sum(square(shifted_sample), 0));
+    }
+<?      } else { ?>
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), generator);
+    for (uword counter = 0; counter < <?=$clusters?>; counter++)
+      modible_state.centers.col(<?=$offset?> + counter)
+          = sample.col(order[counter % sample_size]);
+<?      } ?>
+<?  } ?>
+  }
+
+  void GetResult(<?=typed_ref_args($outputs)?>) {
+    Json::Value result(Json::objectValue);
+    result["iteration"] = (Json::Value::Int64) constant_state.iteration;
+    Json::Value models(Json::arrayValue);
+<?  foreach ($modelClusters as $model => $clusters) {
+        $offset = $offsets[$model];
+        // A model is the best if it has the lowest score among the models with
+        // the same number of clusters; ties go to the earliest model.
+        $rivals = array_keys($modelClusters, $clusters); ?>
+    {
+      Json::Value model(Json::objectValue);
+      model["clusters"] = <?=$clusters?>;
+      ToJson(constant_state.centers.cols(<?=$offset?>, <?=$offset + $clusters - 1?>),
+             model["centers"]);
+      model["score"] = scores[<?=$model?>];
+      model["converged"] = (bool) constant_state.converged[<?=$model?>];
+      model["iteration"] = (Json::Value::UInt64) constant_state.iterations[<?=$model?>];
+      model["best"] = true<?
+        foreach ($rivals as $rival)
+            if ($rival != $model)
+                echo PHP_EOL, '          && scores[', $model, '] ',
+                     $rival < $model ? '<' : '<=', ' scores[', $rival, ']'; ?>;
+      models.append(model);
+    }
+<?  } ?>
+    result["models"] = models;
+<?= ProduceResult(array_keys($outputs)[0], "result") ?>
+  }
+};
+
+<?  return [
+        'kind'             => 'GLA',
+        'name'             => $className,
+        'system_headers'   => ['armadillo', 'string', 'iostream', 'limits',
+                               'random', 'vector', 'algorithm', 'numeric'],
+        'user_headers'     => [],
+        'lib_headers'      => ['ArmaJson'],
+        'iterable'         => TRUE,
+        'input'            => $inputs,
+        'output'           => $outputs,
+        'result_type'      => 'single',
+        'generated_state'  => $constantState,
+    ];
+} ?>
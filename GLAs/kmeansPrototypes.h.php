@@ -0,0 +1,404 @@
+<?
+// This GLA performs k-prototypes clustering, the extension of k-means to data
+// with both numeric and categorical attributes. Each cluster is represented by
+// a prototype consisting of the mean of the numeric attributes and the mode of
+// each factor. The distance between an item and a prototype is the squared
+// Euclidean distance between the numeric parts plus gamma times the number of
+// factors in which the item and the mode differ. This is done via the following:
+// 1. Items are decoded once and buffered into a block. The factors of each item
+//    are packed into a row of integer codes, one per factor.
+// 2. The squared Euclidean distances between the block and every center are
+//    computed as |x|^2 - 2 * x^T * c + |c|^2 via a single matrix product.
+// 3. The mismatches between each item and every mode are counted by comparing
+//    whole registers of codes at once, see kmeansKernels.h.
+// 4. The count of each level of each factor is kept per cluster, so that the
+//    new modes can be found at the end of each iteration. Each item increments
+//    a single count per factor, regardless of the number of levels.
+
+// Template Args:
+// number.clusters: The number of clusters, k.
+// gamma:           The weight of a single mismatched factor relative to the
+//   squared Euclidean distance. Huang suggests between a third and two thirds
+//   of the average standard deviation of the numeric attributes.
+// sample.size:     The size of the sample used to pick initial prototypes.
+// block.size:      The number of items in each block.
+// max.iteration:   The maximum number of iterations.
+// epsilon:         The maximum change in a center allowed for convergence. The
+//   modes must not change at all for convergence.
+function K_Prototypes_Constant_State(array $t_args)
+{
+    // Grabbing variables from $t_args
+    $className      = $t_args['className'];
+    $numberClusters = $t_args['numberClusters'];
+    $numNumeric     = $t_args['numNumeric'];
+    $numFactors     = $t_args['numFactors'];
+    $codeType       = $t_args['codeType'];
+?>
+using namespace arma;
+using namespace std;
+
+class <?=$className?>ConstantState {
+ public:
+  // The integer type used to store the level of a factor.
+  typedef <?=$codeType?> Code;
+
+  // The number of codes in each mode, including the padding.
+  static const constexpr uword kStride
+      = kmeans_kernels::CodeStride<Code>(<?=$numFactors?>);
+
+ private:
+  // The current iteration which is to be compared to $maxIteration.
+  long iteration;
+<?  if ($numNumeric > 0) { ?>
+
+  // Each column is the numeric part of the prototype of a cluster.
+  mat::fixed<<?=$numNumeric?>, <?=$numberClusters?>> centers;
+<?  } ?>
+
+  // The categorical part of each prototype, stored consecutively. The padding
+  // at the end of each mode is always zero.
+  std::vector<Code> modes;
+
+ public:
+  friend class <?=$className?>;
+
+  <?=$className?>ConstantState()
+      : iteration(0),
+<?  if ($numNumeric > 0) { ?>
+        centers(),
+<?  } ?>
+        modes(<?=$numberClusters?> * kStride, 0) {
+  }
+};
+<?
+    return [
+        'kind' => 'RESOURCE',
+        'name' => $className . 'ConstantState',
+        'system_headers' => array('armadillo', 'cstdint', 'vector'),
+        'user_headers' => array(),
+        'lib_headers' => array('kmeansKernels'),
+    ];
+}
+
+function K_Prototypes(array $t_args, array $inputs, array $outputs)
+{
+    // Class name is randomly generated
+    $className = generate_name("KProto");
+
+    // Setting output type
+    $outputs = ['_output' => lookupType('JSON')];
+
+    // Processing of template arguments
+    $numberClusters = $t_args['number.clusters'];
+    $gamma          = get_default($t_args, 'gamma', 1);
+    $sampleSize     = get_default($t_args, 'sample.size', $numberClusters);
+    $blockSize      = get_default($t_args, 'block.size', 256);
+    $maxIteration   = get_default($t_args, 'max.iteration', 20);
+    $epsilon        = get_default($t_args, 'epsilon', 0);
+    $debug          = get_default($t_args, 'debug', 0);
+
+    grokit_assert($numberClusters > 0, "The number of clusters must be positive.");
+    grokit_assert($gamma >= 0, "Gamma cannot be negative.");
+    grokit_assert($sampleSize >= $numberClusters,
+                  "The sample size must be at least the number of clusters.");
+    grokit_assert($blockSize > 0, "The block size must be positive.");
+
+    // Splitting the inputs into numeric attributes and factors. The counts of
+    // the levels of every factor are stored in a single column per cluster, so
+    // each factor is given the offset of its first level.
+    $numeric = [];
+    $factors = [];
+    $offsets = [];
+    $totalLevels = 0;
+    foreach ($inputs as $name => $type) {
+        if ($type->is('numeric')) {
+            $numeric[] = $name;
+        } else {
+            grokit_assert($type->is('categorical'), "Unusual type encountered.");
+            $factors[$name] = $type->get('cardinality');
+            $offsets[$name] = $totalLevels;
+            $totalLevels += $factors[$name];
+        }
+    }
+    $numNumeric = count($numeric);
+    $numFactors = count($factors);
+    grokit_assert($numFactors > 0,
+                  "No factors given; K_Means should be used for numeric data.");
+
+    // The levels are packed into the smallest code that can hold all of them.
+    $maxCardinality = max($factors);
+    grokit_assert($maxCardinality <= 65536,
+                  "Factors cannot have more than 65536 levels.");
+    $codeType = $maxCardinality <= 256 ? 'uint8_t' : 'uint16_t';
+
+    $codeArray1 = array_combine(array_keys($inputs), range(0, count($inputs) - 1));
+    $codeArray2 = $numNumeric > 0
+        ? array_combine($numeric, range(0, $numNumeric - 1))
+        : [];
+    $codeArray3 = array_combine(array_keys($factors), range(0, $numFactors - 1));
+
+    // The GLA for reservoir sampling is created.
+    $samplingClass = lookupGLA(
+        "statistics::Reservoir_Sampling",
+        array('coefficient' => 22,
+              'size'        => $sampleSize),
+        $inputs,
+        $inputs
+    );
+?>
+
+using namespace arma;
+using namespace std;
+
+class <?=$className?>;
+
+<?  $constantState = lookupResource(
+        "statistics::K_Prototypes_Constant_State",
+        array(
+            'className'      => $className,
+            'numberClusters' => $numberClusters,
+            'numNumeric'     => $numNumeric,
+            'numFactors'     => $numFactors,
+            'codeType'       => $codeType,
+        )
+    ); ?>
+
+class <?=$className?> {
+ public:
+  typedef <?=$constantState?>::Code Code;
+
+  static const constexpr uword kStride = <?=$constantState?>::kStride;
+
+ private:
+  // The typical constant state for an iterable GLA.
+  const <?=$constantState?> & constant_state;
+<?  if ($numNumeric > 0) { ?>
+
+  // A matrix where the k-th column is the sum of the numeric parts of the items
+  // in the k-th cluster. These sums are used to calculate the new centers.
+  mat::fixed<<?=$numNumeric?>, <?=$numberClusters?>> sums;
+<?  } ?>
+
+  // The number of items in each cluster.
+  rowvec::fixed<<?=$numberClusters?>> counts;
+
+  // The number of items in each cluster with each level of each factor. There is
+  // a column per cluster, in which the levels of each factor are contiguous.
+  mat level_counts;
+
+  // The sum of the distances between each item and its nearest prototype.
+  double total_score;
+
+  // The reservoir sampling GLA that is used to construct the sample from which
+  // the initial prototypes are picked.
+  <?=$samplingClass?> sampling_GLA;
+<?  if ($numNumeric > 0) { ?>
+
+  // The numeric parts of the buffered items, one per column.
+  mat block;
+<?  } ?>
+
+  // The codes of the buffered items, with kStride codes per item. The padding
+  // is always zero, matching that of the modes.
+  std::vector<Code> block_codes;
+
+  // The number of items currently in the block.
+  uword block_count;
+
+  // The distance between each prototype and each item in the block, with one
+  // row per prototype and one column per item.
+  mat block_distances;
+
+  // The number of factors in which the current item differs from each mode.
+  std::uint32_t mismatches[<?=$numberClusters?>];
+
+  // The version of the mismatch kernel chosen for this CPU.
+  kmeans_kernels::Mismatches<Code> count_mismatches;
+
+  // The index of the prototype which is closest to the item.
+  uword index;
+
+ public:
+  <?=$className?>(const <?=$constantState?> & state)
+      : constant_state(state),
+<?  if ($numNumeric > 0) { ?>
+        sums(zeros<mat>(<?=$numNumeric?>, <?=$numberClusters?>)),
+<?  } ?>
+        counts(zeros<rowvec>(<?=$numberClusters?>)),
+        level_counts(zeros<mat>(<?=$totalLevels?>, <?=$numberClusters?>)),
+        total_score(0),
+        sampling_GLA(),
+<?  if ($numNumeric > 0) { ?>
+        block(<?=$numNumeric?>, <?=$blockSize?>),
+<?  } ?>
+        block_codes(<?=$blockSize?> * kStride, 0),
+        block_count(0),
+        block_distances(<?=$numberClusters?>, <?=$blockSize?>),
+        count_mismatches(kmeans_kernels::SelectMismatches<Code>()),
+        index(0) {
+  }
+
+  void AddItem(<?=const_typed_ref_args($inputs)?>) {
+    if (constant_state.iteration == 0) {
+      sampling_GLA.AddItem(<?=args($inputs)?>);
+      return;
+    }
+<?  foreach ($codeArray2 as $name => $counter) { ?>
+    block(<?=$counter?>, block_count) = <?=$name?>;
+<?  } ?>
+    Code* codes = block_codes.data() + block_count * kStride;
+<?  foreach ($codeArray3 as $name => $counter) { ?>
+    codes[<?=$counter?>] = <?=$name?>.GetID();
+<?  } ?>
+    block_count++;
+    if (block_count == <?=$blockSize?>)
+      FlushBlock();
+  }
+
+  // Assigns every item in the block to its nearest prototype.
+  void FlushBlock() {
+    if (block_count == 0)
+      return;
+<?  if ($numNumeric > 0) { ?>
+    auto points = block.head_cols(block_count);
+    block_distances = constant_state.centers.t() * points;
+    block_distances *= -2;
+    block_distances.each_row() += sum(square(points), 0);
+    block_distances.each_col() += trans(sum(square(constant_state.centers), 0));
+    // Rounding can cause slightly negative distances for points on a center.
+    block_distances = clamp(block_distances, 0, datum::inf);
+<?  } else { ?>
+    block_distances.zeros(<?=$numberClusters?>, block_count);
+<?  } ?>
+    for (uword counter = 0; counter < block_count; counter++) {
+      const Code* codes = block_codes.data() + counter * kStride;
+      count_mismatches(codes, constant_state.modes.data(), kStride,
+                       <?=$numberClusters?>, mismatches);
+      for (uword c_counter = 0; c_counter < <?=$numberClusters?>; c_counter++)
+        block_distances(c_counter, counter) += <?=$gamma?> * mismatches[c_counter];
+      total_score += block_distances.col(counter).min(index);
+<?  if ($numNumeric > 0) { ?>
+      sums.col(index) += points.col(counter);
+<?  } ?>
+      counts[index] ++;
+<?  foreach ($codeArray3 as $name => $counter) { ?>
+      level_counts(<?=$offsets[$name]?> + codes[<?=$counter?>], index) ++;
+<?  } ?>
+    }
+    block_count = 0;
+  }
+
+  void AddState(<?=$className?> & other) {
+    if (constant_state.iteration == 0) {
+      sampling_GLA.AddState(other.sampling_GLA);
+      return;
+    }
+    FlushBlock();
+    other.FlushBlock();
+<?  if ($numNumeric > 0) { ?>
+    sums   += other.sums;
+<?  } ?>
+    counts += other.counts;
+    level_counts += other.level_counts;
+    total_score  += other.total_score;
+  }
+
+  bool ShouldIterate(<?=$constantState?> & modible_state) {
+    // The final state may never have been merged, so its block is emptied here.
+    FlushBlock();
+    if (constant_state.iteration == 0) {
+      InitializePrototypes(modible_state);
+      modible_state.iteration++;
+      return true;
+    }
+
+    bool has_converged = true;
+<?  if ($numNumeric > 0) { ?>
+    vec new_center(<?=$numNumeric?>);
+<?  } ?>
+    uword new_level;
+    for (uword c_counter = 0; c_counter < <?=$numberClusters?>; c_counter++) {
+      // Empty clusters keep their previous prototype.
+      if (counts[c_counter] == 0)
+        continue;
+<?  if ($numNumeric > 0) { ?>
+      new_center = sums.col(c_counter) / counts[c_counter];
+      has_converged = has_converged
+          && max(abs(modible_state.centers.col(c_counter) - new_center)) <= <?=$epsilon?>;
+      modible_state.centers.col(c_counter) = new_center;
+<?  } ?>
+      Code* mode = modible_state.modes.data() + c_counter * kStride;
+<?  foreach ($codeArray3 as $name => $counter) {
+        $offset = $offsets[$name]; ?>
+      level_counts.col(c_counter)
+          .subvec(<?=$offset?>, <?=$offset + $factors[$name] - 1?>).max(new_level);
+      has_converged = has_converged && mode[<?=$counter?>] == new_level;
+      mode[<?=$counter?>] = new_level;
+<?  } ?>
+    }
+    modible_state.iteration++;
+<?  if ($debug) { ?>
+    cout << "iteration: " << modible_state.iteration << endl;
+    cout << "counts: " << counts << endl;
+    cout << "score: " << total_score << endl;
+<?  } ?>
+    return !has_converged && modible_state.iteration < <?=$maxIteration?>;
+  }
+
+  // The initial prototypes are distinct items picked at random from the sample.
+  void InitializePrototypes(<?=$constantState?> & modible_state) {
+    uword sample_size = sampling_GLA.GetSize();
+    std::default_random_engine generator(std::random_device()());
+    std::vector<uword> order(sample_size);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), generator);
+    for (uword counter = 0; counter < <?=$numberClusters?>; counter++) {
+      auto& item = sampling_GLA.GetSample(order[counter % sample_size]);
+      Code* mode = modible_state.modes.data() + counter * kStride;
+<?  foreach ($codeArray1 as $name => $counter) {
+        if (array_key_exists($name, $codeArray2)) { ?>
+      modible_state.centers(<?=$codeArray2[$name]?>, counter) = get<<?=$counter?>>(item);
+<?      } else { ?>
+      mode[<?=$codeArray3[$name]?>] = get<<?=$counter?>>(item).GetID();
+<?      } ?>
+<?  } ?>
+    }
+  }
+
+  void GetResult(<?=typed_ref_args($outputs)?>) {
+    Json::Value result(Json::objectValue);
+    result["iteration"] = (Json::Value::Int64) constant_state.iteration;
+<?  if ($numNumeric > 0) { ?>
+    ToJson(constant_state.centers, result["centers"]);
+<?  } ?>
+    Json::Value modes(Json::arrayValue);
+    for (uword counter = 0; counter < <?=$numberClusters?>; counter++) {
+      const Code* mode = constant_state.modes.data() + counter * kStride;
+      Json::Value levels(Json::objectValue);
+<?  foreach ($codeArray3 as $name => $counter) { ?>
+      levels["<?=$name?>"] = (Json::Value::UInt) mode[<?=$counter?>];
+<?  } ?>
+      modes.append(levels);
+    }
+    result["modes"] = modes;
+    ToJson(counts, result["counts"]);
+    result["total_score"] = total_score;
+<?= ProduceResult(array_keys($outputs)[0], "result") ?>
+  }
+};
+
+<?  return [
+        'kind'             => 'GLA',
+        'name'             => $className,
+        'system_headers'   => ['armadillo', 'string', 'iostream', 'limits',
+                               'random', 'vector', 'algorithm', 'numeric',
+                               'cstdint'],
+        'user_headers'     => [],
+        'lib_headers'      => ['ArmaJson', 'kmeansKernels'],
+        'iterable'         => TRUE,
+        'input'            => $inputs,
+        'output'           => $outputs,
+        'result_type'      => 'single',
+        'generated_state'  => $constantState,
+    ];
+} ?>
@@ -23,6 +23,7 @@ function Logistic_Regression_Constant_State(array $t_args)
     $numberDrugs  = $t_args['numberDrugs'];
     $numberModels = $t_args['numberModels'];
     $numberStrata = $t_args['numberStrata'];
+    $newton       = $t_args['newton'];
 ?>
 
 using namespace arma;
@@ -34,8 +35,10 @@ class <?=$className?>ConstantState {
   long iteration;
 
   // A matrix of coefficients. The format of the entries are as follows:
-  // a) The nth column corresponds to a model for the nth AE, which is computed
-  //    somewhat indepedently of the other models.
+  // a) The nth row corresponds to a model for the nth AE, which is computed
+  //    somewhat indepedently of the other models, and the nth column to the nth
+  //    drug. The coefficients of a drug across all models are contiguous, as
+  //    each item only involves the few drugs that the patient used.
   // b) The first x slots are reserved for group intercept terms, where x is the
   //    maximum number of groups across all models.
   // c) Not all x slots are necessarily used for each model. Hence there will be
@@ -45,17 +48,27 @@ class <?=$className?>ConstantState {
   // per the ELR analysis.
   // The mathematical object is separated into two different data structures to
   // ease access and computation.
-  mat::fixed<<?=$numberDrugs?>, <?=$numberModels?>> beta_drugs;
+  mat::fixed<<?=$numberModels?>, <?=$numberDrugs?>> beta_drugs;
   mat beta_strata;
 
   // The mappings from strata (represented as an integer) to its group's index
-  // for each adverse effect model, which are independent of each other.
-  //int groupings [<?=$numberModels?>][<?=$numberStrata?>];
-  umat::fixed<<?=$numberStrata?>, <?=$numberModels?>> groupings;
+  // for each adverse effect model, which are independent of each other. The
+  // nth column holds the groups of the nth stratum for every model.
+  umat::fixed<<?=$numberModels?>, <?=$numberStrata?>> groupings;
 
   // The number of slots reserved for intercepts in any beta_drugs column. The
   // matrix cannot be jagged, so some unneeded memory is allocated.
   int num_groups;
+<?  if ($newton) { ?>
+
+  // The last step taken for each coefficient, laid out as the coefficients.
+  mat::fixed<<?=$numberModels?>, <?=$numberDrugs?>> step_drugs;
+  mat step_strata;
+
+  // The log-likelihood of each model at the coefficients before the last step,
+  // up to a constant.
+  vec::fixed<<?=$numberModels?>> loglik;
+<?  } ?>
 
  public:
   friend class <?=$className?>;
@@ -66,6 +79,10 @@ class <?=$className?>ConstantState {
         groupings(),
         num_groups(0) {
     beta_drugs.ones();
+<?  if ($newton) { ?>
+    step_drugs.zeros();
+    loglik.fill(-datum::inf);
+<?  } ?>
   }
 };
 <?php
@@ -110,6 +127,32 @@ function Logistic_Regression(array $t_args, array $inputs, array $outputs) {
     $alpha = .25;
     $splineLink = TRUE;
     $relativeChange = 0.05;
+
+    // The optimizer, either 'gradient' for the gradient ascent above or
+    // 'newton' for a diagonal Newton method. The latter also accumulates the
+    // diagonal of the negative Hessian and the log-likelihood of each model
+    // in the same pass as the gradient. Each coefficient then takes a Newton
+    // step. A model whose log-likelihood fell since the last pass instead
+    // halves its last step, which is a backtracking line search spread over
+    // consecutive passes. The full Hessian and L-BFGS are not used, as either
+    // would need several times the memory of the coefficients, which are
+    // already very large. The fitting ends once no model improves its
+    // log-likelihood by more than tolerance, relatively, or after
+    // max.iteration passes.
+    $optimizer = get_default($t_args, 'optimizer', 'gradient');
+    grokit_assert(in_array($optimizer, ['gradient', 'newton']),
+                  "Incorrect specification for optimizer.");
+    $newton = $optimizer == 'newton';
+    $tolerance = get_default($t_args, 'tolerance', 1e-6);
+    $maxIteration = get_default($t_args, 'max.iteration', 25);
+
+    // The constants of the spline link. For z < 0, g(z) = a / (1 + exp(k * z)).
+    // Otherwise, g(z) = b + c / (1 + exp(l * z)).
+    $a = 2 * $alpha;
+    $k = 2 * ($alpha - 1);
+    $b = 2 * $alpha - 1;
+    $c = 2 * (1 - $alpha);
+    $l = -2 * $alpha;
 ?>
 
 using namespace std;
@@ -124,6 +167,7 @@ class <?=$className?>;
             'numberDrugs'  => $numberDrugs,
             'numberModels' => $numberModels,
             'numberStrata' => $numberStrata,
+            'newton'       => $newton,
         )
     ); ?>
 
@@ -147,10 +191,33 @@ class <?=$className?> {
 
   // Statistics used for typical gradient descent.
 
-  // The sums of y_i * x_i * g(-y_i * z_i) for each adverse effect.
-  mat::fixed<<?=$numberDrugs?>, <?=$numberModels?>> XYG_drugs;
+  // The sums of y_i * x_i * g(-y_i * z_i) for each adverse effect. The drugs
+  // are laid out as in beta_drugs, one column per drug.
+  mat::fixed<<?=$numberModels?>, <?=$numberDrugs?>> XYG_drugs;
   mat XYG_strata;
 
+  // The linear predictors of every model for the current item and the values
+  // of g at them.
+  vec::fixed<<?=$numberModels?>> z;
+  vec::fixed<<?=$numberModels?>> g_z;
+
+  // The exponentials from which g_z is formed.
+  vec::fixed<<?=$numberModels?>> e_z;
+<?  if ($newton) { ?>
+
+  // The sums of x_i^2 * g'(z_i), i.e. the diagonal of the negative Hessian,
+  // laid out as XYG_drugs and XYG_strata.
+  mat::fixed<<?=$numberModels?>, <?=$numberDrugs?>> H_drugs;
+  mat H_strata;
+
+  // The values of g' at the linear predictors of the current item.
+  vec::fixed<<?=$numberModels?>> dg_z;
+
+  // The log-likelihood of each model at the current coefficients, up to a
+  // constant.
+  vec::fixed<<?=$numberModels?>> loglik;
+<?  } ?>
+
   // The learning rate. This is needed for typical gradient descent and maybe
   // for RGPS.
   // TODO: Figure out update for RGPS exactly.
@@ -165,12 +232,20 @@ class <?=$className?> {
         XYG_strata(state.num_groups, <?=$numberModels?>),
         N_s(),
         N_plus(),
+<?  if ($newton) { ?>
+        H_strata(state.num_groups, <?=$numberModels?>),
+<?  } ?>
         XYG_drugs() {
     cout << "Started log reg " << endl;
     N_s.zeros();
     N_plus.zeros();
     XYG_drugs.zeros();
     XYG_strata.zeros();
+<?  if ($newton) { ?>
+    H_drugs.zeros();
+    H_strata.zeros();
+    loglik.zeros();
+<?  } ?>
   }
 
   void AddItem(<?=const_typed_ref_args($inputs)?>) {
@@ -183,26 +258,39 @@ class <?=$className?> {
         N_plus[index]++;
     } else {
       tCounter ++;
-
-      arma::colvec z = 
+      const auto& drug_list = <?=$drugs?>.GetResult();
+      const uword* groups = constant_state.groupings.colptr(s);
+
+      // The linear predictors of all models are computed at once. Each drug
+      // that the patient used adds its contiguous column of coefficients.
+      for (int counter = 0; counter < <?=$numberModels?>; counter++)
+        z[counter] = constant_state.beta_strata(groups[counter], counter);
+      for (int index : drug_list)
+        z += constant_state.beta_drugs.unsafe_col(index);
+      G();
+<?  if ($newton) { ?>
+      Curvature();
+      for (int counter = 0; counter < <?=$numberModels?>; counter++)
+        H_strata(groups[counter], counter) += dg_z[counter];
+      for (int index : drug_list)
+        H_drugs.unsafe_col(index) += dg_z;
+<?  } ?>
 
       // first asume there are no adverse efects
-      for (int counter = 0; counter < <?=$numberModels?>; counter++) {
-	int g_i = constant_state.groupings(s,counter);
-        double z = constant_state.beta_strata(g_i, counter) + <?=$drugs?> * constant_state.beta_drugs.unsafe_col(counter);
-        double g_z = g(z);
-        XYG_strata(g_i,counter) -= g_z;
-        for (int index : <?=$drugs?>.GetResult())
-           XYG_drugs(index,counter) -= g_z;
-       }
+      for (int counter = 0; counter < <?=$numberModels?>; counter++)
+        XYG_strata(groups[counter], counter) -= g_z[counter];
+      for (int index : drug_list)
+        XYG_drugs.unsafe_col(index) -= g_z;
 
       // correct the counters for which there are adverse effects
       for (int counter : <?=$effects?>.GetResult()) {
-        int g_i = constant_state.groupings(s,counter);
-        XYG_strata(g_i,counter) += 1;
-        for (int index : <?=$drugs?>.GetResult())
-           XYG_drugs(index, counter) += 1;
-      }      
+        XYG_strata(groups[counter], counter) += 1;
+        for (int index : drug_list)
+           XYG_drugs(counter, index) += 1;
+<?  if ($newton) { ?>
+        loglik[counter] += z[counter];
+<?  } ?>
+      }
 
       if (tCounter % 1000 == 0){
 	cout << "."; cout.flush();
@@ -218,6 +306,11 @@ class <?=$className?> {
     } else {
       XYG_drugs += other.XYG_drugs;
       XYG_strata += other.XYG_strata;
+<?  if ($newton) { ?>
+      H_drugs += other.H_drugs;
+      H_strata += other.H_strata;
+      loglik += other.loglik;
+<?  } ?>
     }
   }
 
@@ -235,7 +328,7 @@ class <?=$className?> {
         int N_min = (int) fmax(10, sqrt(N_plus[model]) / 2);
         for (int strata = 0; strata < <?=$numberStrata?>; strata++) {
           group_count += N_s[strata];
-          modible_state.groupings(strata,model) = group_counter;
+          modible_state.groupings(model, strata) = group_counter;
           if (group_counter >= N_min && strata != <?=$numberStrata - 1?>)
             group_counter++;
         }
@@ -245,12 +338,47 @@ class <?=$className?> {
       int num_groups = max_group_counter + 1;
       cout << "num groups: " << num_groups << endl;
       modible_state.beta_strata = ones(num_groups, <?=$numberModels?>);
-      modible_state.beta_drugs = zeros(<?=$numberDrugs?>, <?=$numberModels?>);
+      modible_state.beta_drugs = zeros(<?=$numberModels?>, <?=$numberDrugs?>);
       modible_state.num_groups = num_groups;
+<?  if ($newton) { ?>
+      modible_state.step_strata = zeros(num_groups, <?=$numberModels?>);
+<?  } ?>
       modible_state.iteration++;
       cout << "Iteration " << modible_state.iteration << " finished." << endl;
       return true;
     } else {
+<?  if ($newton) { ?>
+      // A model is accepted if its last step did not lower its log-likelihood.
+      // The first pass has no previous log-likelihood and is always accepted.
+      uvec accept = loglik >= modible_state.loglik;
+      double improvement = 0;
+      for (int model = 0; model < <?=$numberModels?>; model++)
+        if (accept[model]) {
+          if (modible_state.iteration > 1)
+            improvement = fmax(improvement,
+                               (loglik[model] - modible_state.loglik[model])
+                               / fabs(modible_state.loglik[model]));
+          modible_state.loglik[model] = loglik[model];
+        }
+      bool any_rejected = any(accept == 0);
+      for (int drug = 0; drug < <?=$numberDrugs?>; drug++)
+        for (int model = 0; model < <?=$numberModels?>; model++)
+          Step(accept[model], XYG_drugs(model, drug), H_drugs(model, drug),
+               modible_state.beta_drugs(model, drug),
+               modible_state.step_drugs(model, drug));
+      for (int model = 0; model < <?=$numberModels?>; model++)
+        for (int group = 0; group < modible_state.num_groups; group++)
+          Step(accept[model], XYG_strata(group, model), H_strata(group, model),
+               modible_state.beta_strata(group, model),
+               modible_state.step_strata(group, model));
+      modible_state.iteration++;
+      cout << "Improvement: " << improvement << endl;
+      cout << "Iteration " << modible_state.iteration << " finished." << endl;
+      return    modible_state.iteration <= <?=$maxIteration?>
+
+             && (any_rejected || modible_state.iteration == 2
+                 || improvement > <?=$tolerance?>);
+<?  } else { ?>
       double relative_change = epsilon * fmax(
           max(max(abs(XYG_drugs) / modible_state.beta_drugs)),
           max(max(abs(XYG_strata) / modible_state.beta_strata))
@@ -261,15 +389,32 @@ class <?=$className?> {
       cout << "Change: " << relative_change << endl;
       cout << "Iteration " << modible_state.iteration << " finished." << endl;
       return relative_change > <?=$relativeChange?>;
+<?  } ?>
     }
   }
+<?  if ($newton) { ?>
+
+  // Updates a single coefficient. If its model was accepted, the coefficient
+  // takes a Newton step. Otherwise, the last step is halved by moving back by
+  // half of it.
+  static void Step(bool accept, double gradient, double curvature,
+                   double& beta, double& step) {
+    if (accept) {
+      step = curvature > 0 ? gradient / curvature : 0;
+      beta += step;
+    } else {
+      step /= 2;
+      beta -= step;
+    }
+  }
+<?  } ?>
 
   void GetResult(<?=$outputs[array_keys($outputs)[0]]?> & <?=array_keys($outputs)[0]?>) {
 <?  ProduceResult(
         array_keys($outputs)[0],
         array(
             'iteration' => 'constant_state.iteration',
-            'drug coefficients' => 'constant_state.beta_drugs',
+            'drug coefficients' => 'constant_state.beta_drugs.t()',
             'strata coefficients' => 'constant_state.beta_strata',
         )
     ) ?>
@@ -279,15 +424,55 @@ class <?=$className?> {
     return <?=$sex?> * <?=$numAge * $numYear?> + <?=$age?> * <?=$numYear?> + <?=$year?>;
   }
 
-  /* Experiments with g(z)=z*z show that this is not the bottleneck, only 10% speed improvement */
-  inline double g(double z) {
+  // Computes g_z = g(z) for every model. The exponentials are computed for all
+  // models at once using vectorized code and kept in e_z.
+  void G() {
 <? if ($splineLink) { ?>
-    return (z < 0) ? <?=2 * $alpha?> / (1 + exp(<?=2 * ($alpha - 1)?> * z))
-                   : <?=2 * $alpha - 1 ?> + <?=2 * (1 - $alpha)?> / (1 + exp(<?=-2 * $alpha?> * z));
+    for (int counter = 0; counter < <?=$numberModels?>; counter++)
+      e_z[counter] = z[counter] < 0 ? <?=$k?> * z[counter]
+                                    : <?=$l?> * z[counter];
+    vector_math::Exp(e_z.memptr(), e_z.memptr(), <?=$numberModels?>);
+    for (int counter = 0; counter < <?=$numberModels?>; counter++)
+      g_z[counter] = z[counter] < 0
+          ? <?=$a?> / (1 + e_z[counter])
+          : <?=$b?> + <?=$c?> / (1 + e_z[counter]);
 <? } else { ?>
-    return 1 / (1 + exp(-z));
+    e_z = -z;
+    vector_math::Exp(e_z.memptr(), e_z.memptr(), <?=$numberModels?>);
+    g_z = 1 / (1 + e_z);
 <? } ?>
   }
+<?  if ($newton) { ?>
+
+  // Computes dg_z = g'(z) for every model and subtracts the integral of g from
+  // the log-likelihood, which is that of a patient without any adverse effect.
+  // Both are found from e_z, which is overwritten.
+  void Curvature() {
+    for (int counter = 0; counter < <?=$numberModels?>; counter++) {
+      double inverse = 1 / (1 + e_z[counter]);
+<?      if ($splineLink) { ?>
+      // e / (1 + e)^2 is written as inverse * (1 - inverse), which is 0 rather
+      // than NaN when the exponential overflows.
+      dg_z[counter] = (z[counter] < 0 ? <?=-$a * $k?> : <?=-$c * $l?>)
+                    * inverse * (1 - inverse);
+<?      } else { ?>
+      dg_z[counter] = g_z[counter] * (1 - g_z[counter]);
+<?      } ?>
+      e_z[counter] += 1;
+    }
+    vector_math::Log(e_z.memptr(), e_z.memptr(), <?=$numberModels?>);
+    for (int counter = 0; counter < <?=$numberModels?>; counter++)
+<?      if ($splineLink) { ?>
+      // The integral is shifted by log(2) / k or log(2) / l on each side so that
+      // it is continuous at zero.
+      loglik[counter] -= z[counter] < 0
+          ? <?=$a?> * z[counter] - <?=$a / $k?> * (e_z[counter] - M_LN2)
+          : z[counter] - <?=$c / $l?> * (e_z[counter] - M_LN2);
+<?      } else { ?>
+      loglik[counter] -= z[counter] + e_z[counter];
+<?      } ?>
+  }
+<?  } ?>
 };
 
 <?
@@ -298,7 +483,7 @@ class <?=$className?> {
             'math.h',
             'armadillo',
         ),
-	'lib_headers' => ['ArmaJson'],
+	'lib_headers' => ['ArmaJson', 'vectorMath'],
         'user_headers' => array('json.h'),
         'iterable' => TRUE,
         'input' => $inputs,
@@ -12,10 +12,17 @@ function Mode($t_args, $inputs, $outputs)
 
     $length = $inputs_['index']->get('cardinality');
 
+    // The counts of a previous run can be loaded from the snapshot at the path
+    // given by previous, in which case they are added to the counts of the new
+    // data. If snapshot is given, the final counts are written to that path, so
+    // that the mode can be updated incrementally.
+    $previous = get_default($t_args, 'previous', null);
+    $snapshot = get_default($t_args, 'snapshot', null);
+
     $outputs_ = array_combine(['result'], $inputs);
     $outputs  = array_combine(array_keys($outputs), $outputs_);
 
-    $sys_headers  = ['armadillo'];
+    $sys_headers  = ['armadillo', 'stdexcept'];
     $user_headers = [];
     $lib_headers  = [];
     $libraries    = ['armadillo'];
@@ -51,6 +58,23 @@ class <?=$className?> {
   }
 
   void GetResult(<?=typed_ref_args($outputs_)?>) {
+<?  if ($previous) { ?>
+    // This is only done for the final state, so the previous counts are only
+    // included once.
+    vec previous;
+    if (!previous.load("<?=addcslashes($previous, '"\\')?>", arma_binary)
+        || previous.n_elem != kLength)
+      throw std::runtime_error(
+          "Mode: the snapshot <?=addcslashes($previous, '"\\')?> could not be "
+          "loaded or has the wrong length.");
+    counts += previous;
+<?  } ?>
+<?  if ($snapshot) { ?>
+    if (!counts.save("<?=addcslashes($snapshot, '"\\')?>", arma_binary))
+      throw std::runtime_error(
+          "Mode: the snapshot could not be written to "
+          "<?=addcslashes($snapshot, '"\\')?>.");
+<?  } ?>
     counts.max(result);
   }
 };
@@ -7,6 +7,14 @@ function Naive_Bayes_Classifier_Constant_State(array $t_args)
     // Grabbing variables from $t_args
     $className = $t_args['className'];
     $numN = $t_args['numN'];
+    $numBins = $t_args['numBins'];
+    $singlePass = $t_args['singlePass'];
+    $previous   = $t_args['previous'];
+    $numC       = $t_args['numC'];
+    $factors    = $t_args['factors'];
+    $hasFactors = count($factors) > 0;
+    if ($hasFactors)
+        $maxPower = max($factors);
 ?>
 using namespace arma;
 using namespace std;
@@ -20,6 +28,21 @@ class <?=$className?>ConstantState{
   vec::fixed<<?=$numN?>> min;
   vec::fixed<<?=$numN?>> max;
   vec::fixed<<?=$numN?>> range;
+<?  if ($singlePass || $previous) { ?>
+
+  // The edges of the bins, one column per attribute. These are only evenly
+  // spaced for equal-width binning.
+  mat::fixed<<?=$numBins + 1?>, <?=$numN?>> edges;
+<?  } ?>
+<?  if ($previous) { ?>
+
+  // The counts of the previous model, which are added to those of the new data.
+  ucube previous_numeric;
+<?      if ($hasFactors) { ?>
+  ucube previous_factor;
+<?      } ?>
+  uvec previous_class;
+<?  } ?>
 
   // The total number of entries in the data. It is needed to know the exact
   // index needed for the median.
@@ -34,13 +57,41 @@ class <?=$className?>ConstantState{
         range(),
         count(0),
         iteration(0) {
+<?  if ($previous) { ?>
+    // The snapshot contains the edges followed by the counts, as written by
+    // GetResult. The edges of the previous model are kept as is, so that its
+    // counts remain valid.
+    ifstream file("<?=addcslashes($previous, '"\\')?>", ios::binary);
+    mat previous_edges;
+    bool loaded = previous_edges.load(file, arma_binary)
+               && previous_numeric.load(file, arma_binary)
+<?      if ($hasFactors) { ?>
+               && previous_factor.load(file, arma_binary)
+<?      } ?>
+               && previous_class.load(file, arma_binary);
+    if (   !loaded
+        || previous_edges.n_rows != <?=$numBins + 1?>
+        || previous_edges.n_cols != <?=$numN?>
+        || size(previous_numeric) != size(<?=$numBins + 2?>, <?=$numN?>, <?=$numC?>)
+<?      if ($hasFactors) { ?>
+        || size(previous_factor) != size(<?=$maxPower?>, <?=count($factors)?>, <?=$numC?>)
+<?      } ?>
+        || previous_class.n_elem != <?=$numC?>)
+      throw std::runtime_error(
+          "Naive Bayes Classifier: the snapshot <?=addcslashes($previous, '"\\')?> "
+          "could not be loaded or does not match the model.");
+    edges = previous_edges;
+    min = edges.row(0).t();
+    max = edges.row(<?=$numBins?>).t();
+    range = max - min;
+<?  } ?>
   }
 };
 <?php
     return array(
         'kind'           => 'RESOURCE',
         'name'           => $className . 'ConstantState',
-        'system_headers' => array('armadillo'),
+        'system_headers' => array('armadillo', 'fstream', 'stdexcept'),
         'user_headers'   => array(),
     );
 }
@@ -62,6 +113,32 @@ function Naive_Bayes_Classifier(array $t_args, array $inputs, array $outputs)
     // The number of bins in the histogram range.
     $numBins = $t_args['number.bins'];
 
+    // Whether the model is trained in a single pass. Rather than counting the
+    // bins in a second pass, each state keeps a mergeable quantile sketch of
+    // each numeric attribute for each class, of size sketch.size. The counts of
+    // the bins are then estimated from the sketches in ShouldIterate. This also
+    // allows equal-frequency binning, in which the edges of the bins are the
+    // quantiles of the attribute over all classes, as opposed to equal-width
+    // binning over the range used by the two-pass mode.
+    $singlePass = get_default($t_args, 'single.pass', false);
+    $binning = get_default($t_args, 'binning', 'width');
+    grokit_assert(in_array($binning, ['width', 'frequency']),
+                  "Incorrect specification for binning.");
+    grokit_assert($singlePass || $binning == 'width',
+                  "Equal-frequency binning requires a single pass.");
+    $sketchSize = get_default($t_args, 'sketch.size', 200);
+
+    // An incremental update of a previous model. The counts of the model are
+    // loaded from the snapshot at the path given by previous and the new data
+    // is binned by its edges in a single pass, after which its counts are added
+    // to those of the snapshot. If snapshot is given, the final counts are then
+    // written to that path, so that the next update needs only scan new data.
+    $previous = get_default($t_args, 'previous', null);
+    $snapshot = get_default($t_args, 'snapshot', null);
+    grokit_assert(!$previous || !$singlePass,
+                  "An incremental update uses the bins of the previous model.");
+    $onePass = $singlePass || $previous;
+
     $numericDistributions = array(
         'gaussian',
         'inverseGaussian',
@@ -116,8 +193,13 @@ class <?=$className?>;
 <?  $constantState = lookupResource(
         'statistics::Naive_Bayes_Classifier_Constant_State',
         array(
-            'className' => $className,
-            'numN'      => $numN,
+            'className'  => $className,
+            'numN'       => $numN,
+            'numBins'    => $numBins,
+            'singlePass' => $singlePass,
+            'previous'   => $previous,
+            'numC'       => $numC,
+            'factors'    => $factors,
         )
     ); ?>
 
@@ -134,8 +216,9 @@ class <?=$className?> {
 
 <?  if ($hasFactors) { ?>
   // We need two different vectors here because numeric and factor attributes
-  // are treated quite differently;
-  vec::fixed<<?=$numF?>> factors;
+  // are treated quite differently. The levels are stored as indices of
+  // factor_counts, hence the unsigned type.
+  uvec::fixed<<?=$numF?>> factors;
 
 <?  } ?>
   // These are used for the first iteration to compute the starting statistics.
@@ -161,7 +244,7 @@ class <?=$className?> {
 
   // This is hard coded by co-generation at compile time. It shifts the vector
   // of indices in order to account for each index being from a different row.
-  vec::fixed<<?=$numF?>> index_shift_f;
+  uvec::fixed<<?=$numF?>> index_shift_f;
 
 <?  } ?>
   // This stores the histograms of numeric data. Each slice corresponds to one
@@ -177,6 +260,12 @@ class <?=$className?> {
 
   // This stores the counts of each class of the response.
   uvec::fixed<<?=$numC?>> class_counts;
+<?  if ($singlePass) { ?>
+
+  // The sketches of the numeric attributes. The sketch of the jth attribute for
+  // the cth class is at index c * <?=$numN?> + j.
+  std::vector<quantile_sketch::KLL> sketches;
+<?  } ?>
 
  public:
   <?=$className?>(const <?=$constantState?> &state)
@@ -187,17 +276,47 @@ class <?=$className?> {
         sum(zeros<vec>(<?=$numN?>)),
         sum_squared(zeros<vec>(<?=$numN?>)),
 <?  if ($hasFactors) { ?>
-        factors_counts(zeros<uvec>(<?=$maxPower?>, <?=$numF?>, <?=$numC?>)),
+        factor_counts(zeros<ucube>(<?=$maxPower?>, <?=$numF?>, <?=$numC?>)),
         index_shift_f({<?=$indicesShiftF?>}),
 <?  } ?>
         numeric_counts(zeros<ucube>(<?=$numBins + 2?>, <?=$numN?>, <?=$numC?>)),
         indices(),
         index_shift_n({<?=$indicesShiftN?>}),
+<?  if ($singlePass) { ?>
+        class_counts(zeros<uvec>(<?=$numC?>)),
+        sketches() {
+    for (int counter = 0; counter < <?=$numC * $numN?>; counter++)
+      sketches.emplace_back(<?=$sketchSize?>);
+<?  } else { ?>
         class_counts(zeros<uvec>(<?=$numC?>)) {
+<?  } ?>
   }
 
   void AddItem(<?=const_typed_ref_args($inputs)?>) {
     <?=inputs_to_vector(array_flip($numeric))?>
+<?  if ($previous) { ?>
+    for (int counter = 0; counter < <?=$numN?>; counter++)
+      indices[counter] = counter * <?=$numBins + 2?> + Bin(counter, item[counter]);
+    numeric_counts.slice(<?=$response?>).elem(indices) += 1;
+<?      if ($hasFactors) { ?>
+    <?=inputs_to_vector($factors, 'factors')?>
+    factors += index_shift_f;
+    factor_counts.slice(<?=$response?>).elem(factors) += 1;
+<?      } ?>
+    class_counts(<?=$response?>)++;
+<?  } else if ($singlePass) { ?>
+    sum += item;
+    sum_squared += item % item;
+    count++;
+    for (int counter = 0; counter < <?=$numN?>; counter++)
+      sketches[<?=$response?> * <?=$numN?> + counter].Insert(item[counter]);
+<?      if ($hasFactors) { ?>
+    <?=inputs_to_vector($factors, 'factors')?>
+    factors += index_shift_f;
+    factor_counts.slice(<?=$response?>).elem(factors) += 1;
+<?      } ?>
+    class_counts(<?=$response?>)++;
+<?  } else { ?>
     if (constant_state.iteration == 0) {
       sum += item;
       sum_squared += item % item;
@@ -245,9 +364,27 @@ class <?=$className?> {
 <?  } ?>
       class_counts(<?=$response?>)++;
     }
+<?  } ?>
   }
 
   void AddState(<?=$className?> &other) {
+<?  if ($previous) { ?>
+    numeric_counts += other.numeric_counts;
+<?      if ($hasFactors) { ?>
+    factor_counts += other.factor_counts;
+<?      } ?>
+    class_counts += other.class_counts;
+<?  } else if ($singlePass) { ?>
+    sum += other.sum;
+    sum_squared += other.sum_squared;
+    count += other.count;
+    for (int counter = 0; counter < <?=$numC * $numN?>; counter++)
+      sketches[counter].Merge(other.sketches[counter]);
+<?      if ($hasFactors) { ?>
+    factor_counts += other.factor_counts;
+<?      } ?>
+    class_counts += other.class_counts;
+<?  } else { ?>
     if (constant_state.iteration == 0) {
       sum += other.sum;
       sum_squared += other.sum_squared;
@@ -263,9 +400,66 @@ class <?=$className?> {
 <?  } ?>
       class_counts += other.class_counts;
     }
+<?  } ?>
   }
 
   bool ShouldIterate(<?=$constantState?> &modible_state) {
+<?  if ($previous) { ?>
+    numeric_counts += modible_state.previous_numeric;
+<?      if ($hasFactors) { ?>
+    factor_counts += modible_state.previous_factor;
+<?      } ?>
+    class_counts += modible_state.previous_class;
+    modible_state.count = accu(class_counts);
+    modible_state.iteration++;
+    return false;
+<?  } else if ($singlePass) { ?>
+    modible_state.count = count;
+    for (int attribute = 0; attribute < <?=$numN?>; attribute++) {
+      // The distribution of the attribute over all classes.
+      quantile_sketch::KLL pooled(<?=$sketchSize?>);
+      for (int class_counter = 0; class_counter < <?=$numC?>; class_counter++)
+        pooled.Merge(sketches[class_counter * <?=$numN?> + attribute]);
+<?      if ($binning == 'width') { ?>
+      double mean = sum[attribute] / count;
+      double var = (sum_squared[attribute] / count - mean * mean)
+                 * (1.0 + 1.0 / (count - 1));
+      double width = sqrt(var) * <?=$histogramWidthFactor?>;
+      double low = fmax(mean - width, pooled.Min());
+      double high = fmin(mean + width, pooled.Max());
+      modible_state.edges.col(attribute)
+          = linspace<vec>(low, high, <?=$numBins + 1?>);
+<?      } else { ?>
+      for (int counter = 0; counter <= <?=$numBins?>; counter++)
+        modible_state.edges(counter, attribute)
+            = pooled.Quantile((double) counter / <?=$numBins?>);
+<?      } ?>
+      modible_state.min[attribute] = modible_state.edges(0, attribute);
+      modible_state.max[attribute] = modible_state.edges(<?=$numBins?>, attribute);
+
+      // The count of each bin is the difference of the ranks of its edges. As
+      // in the two-pass mode, the first and last slots are for values outside
+      // of the edges and values equal to the last edge go in the last bin.
+      for (int class_counter = 0; class_counter < <?=$numC?>; class_counter++) {
+        const quantile_sketch::KLL& sketch
+            = sketches[class_counter * <?=$numN?> + attribute];
+        double previous = sketch.Rank(modible_state.edges(0, attribute));
+        numeric_counts(0, attribute, class_counter) = round(previous);
+        for (int counter = 1; counter <= <?=$numBins?>; counter++) {
+          double rank = sketch.Rank(modible_state.edges(counter, attribute),
+                                    counter == <?=$numBins?>);
+          numeric_counts(counter, attribute, class_counter)
+              = round(rank - previous);
+          previous = rank;
+        }
+        numeric_counts(<?=$numBins + 1?>, attribute, class_counter)
+            = round(sketch.Count() - previous);
+      }
+    }
+    modible_state.range = modible_state.max - modible_state.min;
+    modible_state.iteration++;
+    return false;
+<?  } else { ?>
     if (constant_state.iteration == 0) {
       vec::fixed<<?=$numN?>> mean(sum / count);
       vec::fixed<<?=$numN?>> var(sum_squared / count - mean % mean);
@@ -285,10 +479,24 @@ class <?=$className?> {
       modible_state.iteration++;
       return false;
     }
+<?  } ?>
   }
 
   void GetResult(<?=typed_ref_args($outputs)?>) {
-    if (constant_state.iteration > 1) {
+    if (constant_state.iteration > <?=$onePass ? 0 : 1?>) {
+<?  if ($snapshot) { ?>
+      ofstream file("<?=addcslashes($snapshot, '"\\')?>", ios::binary);
+      bool saved = GetEdges().save(file, arma_binary)
+                && numeric_counts.save(file, arma_binary)
+<?      if ($hasFactors) { ?>
+                && factor_counts.save(file, arma_binary)
+<?      } ?>
+                && class_counts.save(file, arma_binary);
+      if (!saved)
+        throw std::runtime_error(
+            "Naive Bayes Classifier: the snapshot could not be written to "
+            "<?=addcslashes($snapshot, '"\\')?>.");
+<?  } ?>
       cube numeric_probabilities(<?= $numBins + 2 ?>, <?=$numN?>, <?=$numC?>);
       ucube::iterator first_iter = numeric_counts.begin();
       cube::iterator second_iter = numeric_probabilities.begin();
@@ -303,7 +511,7 @@ class <?=$className?> {
       first_iter = factor_counts.begin();
       second_iter = factor_probabilities.begin();
       end = factor_counts.end();
-      for(first_iter; first_iter != end; ++first_iter) {
+      for(; first_iter != end; ++first_iter) {
         *second_iter = (double) *first_iter;
         ++second_iter;
       }
@@ -318,6 +526,12 @@ class <?=$className?> {
         result["max"].append(constant_state.max(counter));
         result["min"].append(constant_state.min(counter));
       }
+<?  if ($onePass) { ?>
+<?      foreach ($numeric as $counter => $name) { ?>
+      for (int counter = 0; counter <= <?=$numBins?>; counter++)
+        result["edges"]["<?=$name?>"].append(constant_state.edges(counter, <?=$counter?>));
+<?      } ?>
+<?  } ?>
 <?  foreach ($numeric as $counter => $name) { ?>
       for (int class_counter = 0; class_counter < <?=$numC?>; class_counter++) {
         for (int counter = 0; counter < <?= $numBins + 2 ?>; counter++) {
@@ -328,12 +542,12 @@ class <?=$className?> {
       }
 <?  } ?>
 <?  if ($hasFactors) { ?>
-<?      foreach ($numeric as $counter => $name) { ?>
+<?      foreach (array_keys($factors) as $counter => $name) { ?>
       for (int class_counter = 0; class_counter < <?=$numC?>; class_counter++) {
-        for (int counter = 0; counter < <?= $numBins + 2 ?>; counter++) {
+        for (int counter = 0; counter < <?=$factors[$name]?>; counter++) {
           result["categorical"][class_counter]["<?=$name?>"].append(
-              factor_probabilities(counter, <?=$counter?>, class_counter);
-          )
+              factor_probabilities(counter, <?=$counter?>, class_counter)
+          );
         }
       }
 <?      } ?>
@@ -346,19 +560,70 @@ class <?=$className?> {
 <?= ProduceResult(array_keys($outputs)[0], "result") ?>
     }
   }
+
+  // The following are used to build other structures from the trained model,
+  // such as the scoring tables of Naive_Bayes_Predict.
+
+  const ucube& GetNumericCounts() const {
+    return numeric_counts;
+  }
+
+<?  if ($hasFactors) { ?>
+  const ucube& GetFactorCounts() const {
+    return factor_counts;
+  }
+
+<?  } ?>
+  const uvec& GetClassCounts() const {
+    return class_counts;
+  }
+
+  // The edges of the bins, one column per attribute.
+  mat GetEdges() const {
+<?  if ($onePass) { ?>
+    return constant_state.edges;
+<?  } else { ?>
+    mat edges(<?=$numBins + 1?>, <?=$numN?>);
+    for (int counter = 0; counter < <?=$numN?>; counter++)
+      edges.col(counter) = linspace<vec>(constant_state.min[counter],
+                                         constant_state.max[counter],
+                                         <?=$numBins + 1?>);
+    return edges;
+<?  } ?>
+  }
+<?  if ($previous) { ?>
+
+ private:
+  // The slot of a value for the given attribute, found by binary search as the
+  // edges of the previous model need not be evenly spaced. Slot 0 is for values
+  // below the first edge and values equal to the last edge are in the last bin.
+  int Bin(int attribute, double value) const {
+    const double* begin = constant_state.edges.colptr(attribute);
+    const double* end = begin + <?=$numBins + 1?>;
+    if (value == end[-1])
+      return <?=$numBins?>;
+    return std::upper_bound(begin, end, value) - begin;
+  }
+<?  } ?>
 };
 
 <?
     return array(
         'kind'            => 'GLA',
         'name'            => $className,
-        'system_headers'  => array('armadillo', 'string', 'iostream',),
+        'system_headers'  => array('armadillo', 'string', 'iostream', 'vector',
+                                   'algorithm', 'fstream', 'stdexcept'),
         'user_headers'    => array(),
+        'lib_headers'     => $singlePass ? ['quantileSketch'] : [],
         'iterable'        => TRUE,
         'input'           => $inputs,
         'output'          => $outputs,
         'result_type'     => 'single',
         'generated_state' => $constantState,
+        'extra'           => ['response' => $inputs[$response],
+                              'numeric'  => $numeric,
+                              'factors'  => $factors,
+                              'bins'     => $numBins,],
     );
 }
 ?>
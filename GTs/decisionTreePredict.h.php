@@ -0,0 +1,206 @@
+<?
+// This GT predicts the response using a regression tree trained by the
+// Decision_Tree GLA. The tree is compiled once into a flat representation, see
+// include/flatregressiontree.h, which blocks of tuples are then routed through
+// without any virtual calls.
+
+// Template Args:
+// max.node: The maximum ID of a node to descend to, which limits the depth of
+//   the tree used. By default, the leaves are always reached.
+// block.size: The number of tuples routed through the tree together. It
+//   defaults to 1024.
+
+// Inputs: The discrete and continuous vectors, constructed in the same manner
+// as for the Decision_Tree GLA.
+
+// Output: The predicted response.
+function Decision_Tree_Predict_Constant_State(array $t_args)
+{
+    // Grabbing variables from $t_args
+    $className = $t_args['className'];
+    $states    = $t_args['states'];
+    $states_   = array_combine(['state'], $states);
+?>
+
+class <?=$className?>ConstantState {
+ private:
+  // The compiled tree.
+  CLUS::FlatRegressionTree tree;
+
+ public:
+  friend class <?=$className?>;
+
+  <?=$className?>ConstantState(<?=const_typed_ref_args($states_)?>)
+      : tree(state.GetTree().Flatten()) {
+  }
+};
+<?
+    return [
+        'kind'           => 'RESOURCE',
+        'name'           => $className . 'ConstantState',
+        'system_headers' => ['armadillo'],
+        'user_headers'   => [],
+        'lib_headers'    => ['flatregressiontree.h'],
+        'configurable'   => false,
+    ];
+}
+
+function Decision_Tree_Predict(array $t_args, array $inputs, array $outputs,
+                               array $states)
+{
+    // Class name is randomly generated.
+    $className = generate_name("DTreePredict");
+
+    grokit_assert(count($states) == 1,
+                  "Decision Tree Predict: the trained tree must be given.");
+    $model = array_get_index($states, 0);
+
+    // Processing of template arguments.
+    $maxNode = get_default($t_args, 'max.node', null);
+    $blockSize = get_default($t_args, 'block.size', 1024);
+    grokit_assert($blockSize > 0, "block.size must be positive.");
+
+    // Processing of inputs.
+    grokit_assert(count($inputs) == 2,
+                  "Decision Tree Predict: expected 2 inputs.");
+    $inputs_ = array_combine(['dvars', 'cvars'], $inputs);
+    $numDiscrete = $model->get('discrete');
+    $numContinuous = $model->get('continuous');
+    grokit_assert(count($inputs_['dvars']->get('inputs')) == $numDiscrete,
+                  "Decision Tree Predict: expected $numDiscrete discrete "
+                  . "variables.");
+    grokit_assert($inputs_['cvars']->get('size') == $numContinuous,
+                  "Decision Tree Predict: expected $numContinuous continuous "
+                  . "variables.");
+
+    // Processing of outputs.
+    grokit_assert(count($outputs) == 1,
+                  "Decision Tree Predict: expected 1 output.");
+    array_set_index($outputs, 0, lookupType('base::DOUBLE'));
+    $outputs_ = array_combine(['y'], $outputs);
+?>
+
+class <?=$className?>;
+
+<?  $constantState = lookupResource(
+        'statistics::Decision_Tree_Predict_Constant_State',
+        ['className' => $className, 'states' => $states]
+    ); ?>
+
+// Each chunk is scored in two passes. The first pass only buffers the variables
+// of the tuples and no result is returned. Whenever the buffer is full, the
+// block is routed through the tree at once and its predictions are stored. The
+// second pass then returns the prediction of each tuple from its own call, so
+// that the other outputs remain aligned.
+class <?=$className?> {
+ private:
+  using tree_type = CLUS::FlatRegressionTree;
+
+  // The maximum ID of a node to descend to.
+  static const constexpr tree_type::SizeType kMaxNode =
+<?  if (is_null($maxNode)) { ?>
+      std::numeric_limits<tree_type::SizeType>::max();
+<?  } else { ?>
+      <?=$maxNode?>;
+<?  } ?>
+
+  // The number of tuples in a block.
+  static const constexpr arma::uword kBlockSize = <?=$blockSize?>;
+
+  // The proportion at which the predictions grow.
+  static const constexpr int kScale = 2;
+
+  // The constant state containing the compiled tree.
+  const <?=$constantState?>& constant_state;
+
+  // The variables of the buffered tuples, one column per tuple.
+  arma::imat d;
+  arma::mat c;
+
+  // The number of buffered tuples.
+  arma::uword block_count;
+
+  // The prediction for each tuple of the chunk. It only grows, so that its
+  // memory is reused across chunks.
+  arma::vec predictions;
+
+  // The number of tuples in the current chunk.
+  arma::uword count;
+
+  // The index of the next tuple to return during the second pass.
+  arma::uword index;
+
+  // The current pass over the chunk.
+  int iteration;
+
+ public:
+  <?=$className?>(const <?=$constantState?>& state)
+      : constant_state(state),
+        d(<?=max($numDiscrete, 1)?>, kBlockSize),
+        c(<?=$numContinuous?>, kBlockSize),
+        predictions(kBlockSize) {
+  }
+
+  void StartChunk() {
+    iteration = 0;
+    count = 0;
+    block_count = 0;
+  }
+
+  bool ProcessTuple(<?=process_tuple_args($inputs_, $outputs_)?>) {
+    if (iteration == 1) {
+      y = predictions[index++];
+      return true;
+    }
+    for (int i = 0; i < <?=$numDiscrete?>; i++)
+      d(i, block_count) = dvars[i];
+    for (int i = 0; i < <?=$numContinuous?>; i++)
+      c(i, block_count) = cvars[i];
+    count++;
+    if (++block_count == kBlockSize)
+      FlushBlock();
+    return false;
+  }
+
+  bool ShouldIterate() {
+    if (iteration++ > 0)
+      return false;
+    FlushBlock();
+    index = 0;
+    return true;
+  }
+
+ private:
+  // Predicts the buffered tuples, which are the last block_count tuples of the
+  // chunk, and empties the buffer.
+  void FlushBlock() {
+    if (block_count == 0)
+      return;
+    if (count > predictions.n_elem)
+      predictions.resize(std::max(count, predictions.n_elem * kScale));
+    // The block and its predictions are used in place.
+    const arma::imat block_d(d.memptr(), d.n_rows, block_count, false, true);
+    const arma::mat block_c(c.memptr(), c.n_rows, block_count, false, true);
+    arma::vec block_predictions(predictions.memptr() + count - block_count,
+                                block_count, false, true);
+    constant_state.tree.Predict(block_d, block_c, block_predictions, kMaxNode);
+    block_count = 0;
+  }
+};
+
+<?
+    return [
+        'kind'            => 'GT',
+        'name'            => $className,
+        'generated_state' => $constantState,
+        'system_headers'  => ['armadillo', 'algorithm', 'limits'],
+        'user_headers'    => [],
+        'lib_headers'     => ['flatregressiontree.h'],
+        'libraries'       => ['armadillo'],
+        'iterable'        => true,
+        'input'           => $inputs,
+        'output'          => $outputs,
+        'result_type'     => 'single',
+    ];
+}
+?>
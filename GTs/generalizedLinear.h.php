@@ -134,15 +134,35 @@ function GLM_Predict(array $t_args, array $inputs, array $outputs, array $states
         if(sizeof($terms[$counter][0]) == 0)
             $interceptNeeded = false;
 
+    // Whether the rows are stored sparsely, as in GLM. Only the coefficients at
+    // the non-zero elements of a row are read, so the cost of scoring a tuple
+    // depends on the number of terms rather than on the cardinalities of the
+    // factors. This is used by default when there are factors.
+    $hasFactors = false;
+    foreach ($terms as $term)
+        $hasFactors = $hasFactors || count($term[1]) > 0;
+    $sparse = get_default($t_args, 'sparse', $hasFactors);
+
+    // The number of dense rows gathered into a panel before the linear
+    // predictors of the panel are computed with a single matrix-vector product.
+    $blockSize = get_default($t_args, 'block.size', 1024);
+    grokit_assert($blockSize > 0, "block.size must be positive.");
+
     // This finishes processing the models.
-    $inputVector = writeInputVector($terms, $interceptNeeded);
+    $inputVector = $sparse
+        ? writeSparseInputVector($terms, $interceptNeeded)
+        : writeInputVector($terms, $interceptNeeded);
 
     // The number of coefficients to predict
     $numberCoefficients = $inputVector[0];
 
-    // To individually set the Armadillo vector elements
+    // To individually set the Armadillo vector elements, or the positions and
+    // values of the non-zero elements for sparse rows.
     $setterCode = $inputVector[1];
 
+    // The number of non-zero elements in each sparse row.
+    $numberNonZero = $sparse ? $inputVector[2] : $numberCoefficients;
+
     // Construction of C++ code to assign the initial coefficients if they were
     // specified. Otherwise an empty string will be produced.
     $initialCoefficientsCode = $missingStart
@@ -165,52 +185,121 @@ class <?=$className?>;
 ?>
 
 
+// Each chunk is scored in two passes. The first pass only collects the linear
+// predictors of the tuples and no result is returned. Dense rows are gathered
+// into the columns of a panel, whose linear predictors are computed at once as
+// panel^T * beta. Afterwards, the array version of the inverse link is applied
+// to every linear predictor of the chunk. The second pass then returns the mean
+// of each tuple from its own call, so that the other outputs remain aligned.
 class <?=$className?> {
  private:
+  // The number of columns in the panel.
+  static const constexpr uword kBlockSize = <?=$blockSize?>;
+
+  // The proportion at which the vector of means grows.
+  static const constexpr int kScale = 2;
+
   // The typical constant state for an iterable GLA.
   const <?=$constantState?> & constant_state;
 
-  // The following variables are used within the rank-1 updates. Their names
-  // correspond to those found in Princeton paper for ease of comparison.
-  // They are member variables rather than local variables in order to avoid
-  // repeatedly allocating the same memory for them.
+<?  if ($sparse) { ?>
+  // The positions of the non-zero elements of the current row and their values.
+  // They are set at the beginning of the ProcessTuple call.
+  uword indices[<?=$numberNonZero?>];
+  double values[<?=$numberNonZero?>];
+<?  } else { ?>
+  // The dense rows waiting for their linear predictors, one per column. The
+  // setter code fills a column through a pointer named x.
+  mat panel;
 
-  // A vector that contains the current data and whose elements are individually
-  // set at the beginning of the AddItem call.
-  vec::fixed<<?=$numberCoefficients?>> x;
+  // The number of rows in the panel.
+  uword panel_count;
+<?  } ?>
 
-  // The response of the model. It is either a simple variable matching
-  // a parameter of AddItem or an expression containing multiple parameters.
-  // The details are taken care in the PHP cogeneration, which allows this to be
-  // specified as any proper c++ mathematical expression.
-  // TODO: Feed this through something to add namespaces, possibly RToCPP
-  double y;
+  // The linear predictor of each tuple of the chunk, which is replaced by the
+  // mean once the first pass is over. It only grows, so that its memory is
+  // reused across chunks.
+  vec mu;
 
-  // The linear predictor. It is the dot product of the coefficients and the
-  // parameters of AddItem. See IBM's algorithm for more details about how it
-  // is computed during the first iteration before the coefficients are first
-  // predicted.
-  double eta;
+  // The number of tuples in the current chunk.
+  uword count;
 
-  // The predicted mean. This is usually found as the inverse link of eta.
-  double mu;
+  // The index of the next tuple to return during the second pass.
+  uword index;
+
+  // The current pass over the chunk.
+  int iteration;
 
  public:
   <?=$className?>(const <?=$constantState?>& state)
+<?  if ($sparse) { ?>
+      : constant_state(state),
+        mu(kBlockSize) {
+<?  } else { ?>
       : constant_state(state),
-        x() {
+        panel(<?=$numberCoefficients?>, kBlockSize),
+        mu(kBlockSize) {
+<?  } ?>
+  }
+
+  void StartChunk() {
+    iteration = 0;
+    count = 0;
+<?  if (!$sparse) { ?>
+    panel_count = 0;
+<?  } ?>
   }
 
   bool ProcessTuple(<?=process_tuple_args($inputs, $outputs)?>) {
-    // Processing of data
-    x.fill(0.0);
+    if (iteration == 1) {
+      <?=array_keys($outputs)[0]?> = mu[index++];
+      return true;
+    }
+    if (count == mu.n_elem)
+      mu.resize(mu.n_elem * kScale);
+    // The offset is stored now and the product with beta is added to it.
+    mu[count] = 0<?=$offset?>;
+<?  if ($sparse) { ?>
+    <?=$setterCode, PHP_EOL?>
+
+    for (uword counter = 0; counter < <?=$numberNonZero?>; counter++)
+      mu[count] += values[counter] * constant_state.beta[indices[counter]];
+    count++;
+<?  } else { ?>
+    count++;
+    double* x = panel.colptr(panel_count);
+    std::fill(x, x + <?=$numberCoefficients?>, 0.0);
     <?=$setterCode, PHP_EOL?>
 
-    eta = dot(x, constant_state.beta)<?=$offset?>;
-    mu = <?=$linkInverse?>(eta);
-    <?=array_keys($outputs)[0]?> = mu;
+    if (++panel_count == kBlockSize)
+      FlushPanel();
+<?  } ?>
+    return false;
+  }
+
+  bool ShouldIterate() {
+    if (iteration++ > 0)
+      return false;
+<?  if (!$sparse) { ?>
+    FlushPanel();
+<?  } ?>
+    <?=$linkInverse?>(mu.memptr(), mu.memptr(), count);
+    index = 0;
     return true;
   }
+<?  if (!$sparse) { ?>
+
+ private:
+  // Adds the linear predictors of the rows in the panel, which are the last
+  // panel_count tuples of the chunk, to their offsets.
+  void FlushPanel() {
+    if (panel_count == 0)
+      return;
+    mu.subvec(count - panel_count, count - 1)
+        += panel.head_cols(panel_count).t() * constant_state.beta;
+    panel_count = 0;
+  }
+<?  } ?>
 };
 
 <?php
@@ -221,7 +310,8 @@ class <?=$className?> {
                               'armadillo',
                               'iostream',
                               'boost/math/constants/constants.hpp',
-                              'boost/math/special_functions/erf.hpp',],
+                              'boost/math/special_functions/erf.hpp',
+                              'algorithm',],
 	'lib_headers'     => ['glmFamilies', 'ArmaJson'],
         'user_headers'    => ['json.h'],
         'iterable'        => TRUE,
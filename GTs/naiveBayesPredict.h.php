@@ -0,0 +1,320 @@
+<?
+// This GT classifies items using a model trained by Naive_Bayes_Classifier.
+// The counts of the model are converted once into tables of smoothed log
+// probabilities, so that classifying an item only requires finding the bin of
+// each numeric attribute and adding one column of a table per attribute.
+
+// The tables are stored with one row per class, so that the log probabilities
+// of a given bin or level for every class are contiguous. The tables are:
+// 1. The log prior probability of each class.
+// 2. The log probability of each bin of each numeric attribute, including the
+//    slots for values outside of the edges. The column of the bth slot of the
+//    jth attribute is j * (number of bins + 2) + b.
+// 3. The log probability of each level of each factor. The levels of each
+//    factor occupy consecutive columns.
+// A count of zero would give a probability of zero, so all counts are smoothed
+// by adding the Laplace smoothing parameter.
+
+// Template Args:
+// smoothing:  The amount added to each count. It defaults to 1.
+// block.size: The number of tuples scored together. It defaults to 256.
+
+// Inputs: The numeric attributes followed by the factors, in the same order as
+// they were given to the classifier, not including the response.
+
+// Outputs:
+// label:     The index of the most probable class.
+// posterior: Optional. The posterior probability of each class.
+function Naive_Bayes_Predict_Constant_State(array $t_args)
+{
+    // Grabbing variables from $t_args
+    $className   = $t_args['className'];
+    $states      = $t_args['states'];
+    $numC        = $t_args['numC'];
+    $numN        = $t_args['numN'];
+    $numBins     = $t_args['numBins'];
+    $factors     = $t_args['factors'];
+    $smoothing   = $t_args['smoothing'];
+    $states_     = array_combine(['state'], $states);
+    $numLevels   = array_sum($factors);
+?>
+
+using namespace arma;
+
+class <?=$className?>ConstantState {
+ private:
+  // The log prior probabilities of the classes.
+  vec::fixed<<?=$numC?>> prior;
+
+  // The log probabilities of the bins of the numeric attributes.
+  mat::fixed<<?=$numC?>, <?=$numN * ($numBins + 2)?>> numeric_table;
+
+<?  if ($numLevels > 0) { ?>
+  // The log probabilities of the levels of the factors.
+  mat::fixed<<?=$numC?>, <?=$numLevels?>> factor_table;
+
+<?  } ?>
+  // The edges of the bins, one column per attribute.
+  mat::fixed<<?=$numBins + 1?>, <?=$numN?>> edges;
+
+ public:
+  friend class <?=$className?>;
+
+  <?=$className?>ConstantState(<?=const_typed_ref_args($states_)?>)
+      : edges(state.GetEdges()) {
+    const uvec& class_counts = state.GetClassCounts();
+    double total = accu(class_counts);
+    for (int c = 0; c < <?=$numC?>; c++) {
+      prior[c] = std::log((class_counts[c] + <?=$smoothing?>)
+                          / (total + <?=$smoothing * $numC?>));
+      double slots = class_counts[c] + <?=$smoothing * ($numBins + 2)?>;
+      const ucube& numeric_counts = state.GetNumericCounts();
+      for (int j = 0; j < <?=$numN?>; j++)
+        for (int b = 0; b < <?=$numBins + 2?>; b++)
+          numeric_table(c, j * <?=$numBins + 2?> + b)
+              = std::log((numeric_counts(b, j, c) + <?=$smoothing?>) / slots);
+<?  if ($numLevels > 0) { ?>
+      const ucube& factor_counts = state.GetFactorCounts();
+<?      $offset = 0;
+        foreach (array_values($factors) as $index => $cardinality) { ?>
+      for (int level = 0; level < <?=$cardinality?>; level++)
+        factor_table(c, <?=$offset?> + level)
+            = std::log((factor_counts(level, <?=$index?>, c) + <?=$smoothing?>)
+                       / (class_counts[c] + <?=$smoothing * $cardinality?>));
+<?          $offset += $cardinality;
+        } ?>
+<?  } ?>
+    }
+  }
+};
+<?
+    return [
+        'kind'           => 'RESOURCE',
+        'name'           => $className . 'ConstantState',
+        'system_headers' => ['armadillo', 'cmath'],
+        'user_headers'   => [],
+        'configurable'   => false,
+    ];
+}
+
+function Naive_Bayes_Predict(array $t_args, array $inputs, array $outputs,
+                             array $states)
+{
+    // Class name is randomly generated.
+    $className = generate_name("NBP");
+
+    grokit_assert(count($states) == 1,
+                  "Naive Bayes Predict: the trained model must be given.");
+    $model = array_get_index($states, 0);
+
+    // Processing of template arguments.
+    $smoothing = get_default($t_args, 'smoothing', 1);
+    grokit_assert($smoothing > 0, "The smoothing must be positive.");
+    $blockSize = get_default($t_args, 'block.size', 256);
+    grokit_assert($blockSize > 0, "block.size must be positive.");
+
+    // The structure of the model.
+    $numBins   = $model->get('bins');
+    $numC      = $model->get('response')->get('cardinality');
+    $numN      = count($model->get('numeric'));
+    $factors   = $model->get('factors');
+    $numF      = count($factors);
+
+    // Processing of inputs.
+    grokit_assert(count($inputs) == $numN + $numF,
+                  "Naive Bayes Predict: expected " . ($numN + $numF)
+                  . " inputs.");
+    $numeric = array_slice(array_keys($inputs), 0, $numN);
+    $levels  = array_slice(array_keys($inputs), $numN);
+    foreach ($numeric as $name)
+        grokit_assert($inputs[$name]->is('numeric'),
+                      "Naive Bayes Predict: $name should be numeric.");
+    foreach (array_values($factors) as $index => $cardinality)
+        grokit_assert(   $inputs[$levels[$index]]->is('categorical')
+                      && $inputs[$levels[$index]]->get('cardinality')
+                         == $cardinality,
+                      "Naive Bayes Predict: {$levels[$index]} should be a "
+                      . "factor with $cardinality levels.");
+
+    // Processing of outputs.
+    $posterior = count($outputs) == 2;
+    grokit_assert($posterior || count($outputs) == 1,
+                  "Naive Bayes Predict: expected 1 or 2 outputs.");
+    array_set_index($outputs, 0, lookupType('base::INT'));
+    if ($posterior)
+        array_set_index($outputs, 1, lookupType(
+            'base::array',
+            ['size' => $numC, 'type' => lookupType('base::double')]
+        ));
+    $outputs_ = array_combine(
+        $posterior ? ['label', 'posterior'] : ['label'],
+        $outputs
+    );
+?>
+
+using namespace arma;
+
+class <?=$className?>;
+
+<?  $constantState = lookupResource(
+        'statistics::Naive_Bayes_Predict_Constant_State',
+        ['className' => $className,
+         'states'    => $states,
+         'numC'      => $numC,
+         'numN'      => $numN,
+         'numBins'   => $numBins,
+         'factors'   => $factors,
+         'smoothing' => $smoothing,]
+    ); ?>
+
+// Each chunk is scored in two passes. The first pass only buffers the
+// attributes of the tuples and no result is returned. Whenever the buffer is
+// full, the bins of each numeric attribute are found for the whole block and
+// the scores of the block are accumulated by gathering one column of a table
+// per tuple and attribute. The second pass then returns the class of each tuple
+// from its own call, so that the other outputs remain aligned.
+class <?=$className?> {
+ private:
+  // The number of tuples in a block.
+  static const constexpr uword kBlockSize = <?=$blockSize?>;
+
+  // The proportion at which the scores grow.
+  static const constexpr int kScale = 2;
+
+  // The constant state containing the tables.
+  const <?=$constantState?>& constant_state;
+
+  // The numeric attributes of the buffered tuples, one column per attribute,
+  // so that the values of an attribute are contiguous.
+  mat::fixed<kBlockSize, <?=$numN?>> values;
+<?  if ($numF > 0) { ?>
+
+  // The levels of the factors of the buffered tuples, one column per factor.
+  umat::fixed<kBlockSize, <?=$numF?>> levels;
+<?  } ?>
+
+  // The slot of each buffered tuple for the attribute being processed.
+  uvec::fixed<kBlockSize> bins;
+
+  // The number of buffered tuples.
+  uword block_count;
+
+  // The log of the joint probability of each tuple of the chunk and each class,
+  // one column per tuple. It only grows, so that its memory is reused across
+  // chunks.
+  mat scores;
+<?  if ($posterior) { ?>
+
+  // The posterior probabilities of the current tuple.
+  vec::fixed<<?=$numC?>> probabilities;
+<?  } ?>
+
+  // The number of tuples in the current chunk.
+  uword count;
+
+  // The index of the next tuple to return during the second pass.
+  uword index;
+
+  // The current pass over the chunk.
+  int iteration;
+
+ public:
+  <?=$className?>(const <?=$constantState?>& state)
+      : constant_state(state),
+        scores(<?=$numC?>, kBlockSize) {
+  }
+
+  void StartChunk() {
+    iteration = 0;
+    count = 0;
+    block_count = 0;
+  }
+
+  bool ProcessTuple(<?=process_tuple_args($inputs, $outputs_)?>) {
+    if (iteration == 1) {
+      auto column = scores.unsafe_col(index++);
+      label = column.index_max();
+<?  if ($posterior) { ?>
+      probabilities = exp(column - column.max());
+      probabilities /= accu(probabilities);
+      for (int counter = 0; counter < <?=$numC?>; counter++)
+        posterior[counter] = probabilities[counter];
+<?  } ?>
+      return true;
+    }
+<?  foreach ($numeric as $index => $name) { ?>
+    values(block_count, <?=$index?>) = <?=$name?>;
+<?  } ?>
+<?  foreach ($levels as $index => $name) { ?>
+    levels(block_count, <?=$index?>) = <?=$name?>.GetID();
+<?  } ?>
+    count++;
+    if (++block_count == kBlockSize)
+      FlushBlock();
+    return false;
+  }
+
+  bool ShouldIterate() {
+    if (iteration++ > 0)
+      return false;
+    FlushBlock();
+    index = 0;
+    return true;
+  }
+
+ private:
+  // Scores the buffered tuples, which are the last block_count tuples of the
+  // chunk, and empties the buffer.
+  void FlushBlock() {
+    if (block_count == 0)
+      return;
+    uword first = count - block_count;
+    if (count > scores.n_cols)
+      scores.resize(<?=$numC?>, std::max(count, scores.n_cols * kScale));
+    scores.cols(first, count - 1).each_col() = constant_state.prior;
+    for (int attribute = 0; attribute < <?=$numN?>; attribute++) {
+      const double* column = values.colptr(attribute);
+      for (uword counter = 0; counter < block_count; counter++)
+        bins[counter] = attribute * <?=$numBins + 2?> + Bin(attribute, column[counter]);
+      for (uword counter = 0; counter < block_count; counter++)
+        scores.unsafe_col(first + counter)
+            += constant_state.numeric_table.unsafe_col(bins[counter]);
+    }
+<?  $offset = 0;
+    foreach (array_values($factors) as $index => $cardinality) { ?>
+    for (uword counter = 0; counter < block_count; counter++)
+      scores.unsafe_col(first + counter) += constant_state.factor_table.unsafe_col(
+          <?=$offset?> + levels(counter, <?=$index?>));
+<?      $offset += $cardinality;
+    } ?>
+    block_count = 0;
+  }
+
+  // The slot of a value for the given attribute. Slot 0 is for values below
+  // the first edge and the last slot for values above the last edge. As in the
+  // classifier, values equal to the last edge belong to the last bin.
+  int Bin(int attribute, double value) const {
+    const double* begin = constant_state.edges.colptr(attribute);
+    const double* end = begin + <?=$numBins + 1?>;
+    if (value == end[-1])
+      return <?=$numBins?>;
+    return std::upper_bound(begin, end, value) - begin;
+  }
+};
+
+<?
+    return [
+        'kind'            => 'GT',
+        'name'            => $className,
+        'generated_state' => $constantState,
+        'system_headers'  => ['armadillo', 'algorithm', 'cmath'],
+        'user_headers'    => [],
+        'lib_headers'     => [],
+        'libraries'       => ['armadillo'],
+        'iterable'        => true,
+        'input'           => $inputs,
+        'output'          => $outputs,
+        'result_type'     => 'single',
+    ];
+}
+?>
@@ -0,0 +1,231 @@
+// Compares the array versions of the GLM family functions in glmFamilies.h with
+// the scalar versions that they replace. For each function, random inputs are
+// drawn from the domain that GLM uses it on and both versions are timed and
+// compared. The largest error of the array version relative to the scalar one
+// is reported in ULP of the result, in ULP of max(1, |result|) and as an
+// absolute error. The second is the bound given in glmFamilies.h for functions
+// whose result may be close to 0 through cancellation, where the ULP of the
+// result is much smaller than the error of its terms.
+//
+// The kernels of vectorMath.h that have no counterpart in glmFamilies.h are
+// also compared, against the long double versions of the functions they
+// replace rounded to double, i.e. against nearly exact results. Their scalar
+// timings are those of the long double versions.
+//
+// Build and run from the root of the repository, e.g.:
+//   g++ -O2 -std=c++11 -Iinclude bench/glmFamiliesBench.cpp -o glmFamiliesBench
+//   ./glmFamiliesBench [number of inputs] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "glmFamilies.h"
+
+using namespace std;
+
+// The number of representable doubles between a and b.
+double UlpDistance(double a, double b) {
+  if (a == b)
+    return 0;
+  if (!std::isfinite(a) || !std::isfinite(b))
+    return INFINITY;
+  int64_t x, y;
+  memcpy(&x, &a, sizeof(a));
+  memcpy(&y, &b, sizeof(b));
+  // Maps the sign-magnitude representation onto a monotone integer scale.
+  x = x < 0 ? INT64_MIN - x : x;
+  y = y < 0 ? INT64_MIN - y : y;
+  uint64_t distance = x > y ? (uint64_t) x - (uint64_t) y
+                            : (uint64_t) y - (uint64_t) x;
+  return (double) distance;
+}
+
+using Scalar = function<double(double)>;
+using Array = function<void(const double*, double*, size_t)>;
+using ScalarPair = function<double(double, double)>;
+using ArrayPair = function<void(const double*, const double*, double*, size_t)>;
+
+size_t num_inputs = 1 << 20;
+int repetitions = 20;
+mt19937_64 generator(42);
+
+// Times fn over all repetitions and returns the nanoseconds per element.
+double Time(const function<void()>& fn) {
+  fn();  // warm-up
+  auto start = chrono::steady_clock::now();
+  for (int counter = 0; counter < repetitions; counter++)
+    fn();
+  auto end = chrono::steady_clock::now();
+  return chrono::duration<double, nano>(end - start).count()
+       / (repetitions * (double) num_inputs);
+}
+
+void Report(const char* name, const vector<double>& expected,
+            const vector<double>& actual, double scalar_ns, double array_ns) {
+  double max_ulp = 0, max_scaled = 0, max_abs = 0;
+  size_t non_finite = 0;
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (std::isfinite(expected[i]) != std::isfinite(actual[i])) {
+      non_finite++;
+      continue;
+    }
+    max_ulp = max(max_ulp, UlpDistance(expected[i], actual[i]));
+    if (std::isfinite(expected[i])) {
+      double error = fabs(expected[i] - actual[i]);
+      double scale = max(1.0, fabs(expected[i]));
+      max_abs = max(max_abs, error);
+      max_scaled = max(max_scaled, error / (nextafter(scale, INFINITY) - scale));
+    }
+  }
+  printf("%-26s %8.2f %8.2f %7.2fx %10.0f %10.1f %12.3g", name, scalar_ns,
+         array_ns, scalar_ns / array_ns, max_ulp, max_scaled, max_abs);
+  if (non_finite > 0)
+    printf("  (%zu elements finite in only one version)", non_finite);
+  printf("\n");
+}
+
+void Unary(const char* name, Scalar scalar, Array array, double low,
+           double high) {
+  uniform_real_distribution<double> distribution(low, high);
+  vector<double> in(num_inputs), expected(num_inputs), actual(num_inputs);
+  for (double& x : in)
+    x = distribution(generator);
+  double scalar_ns = Time([&] {
+    for (size_t i = 0; i < num_inputs; i++)
+      expected[i] = scalar(in[i]);
+  });
+  double array_ns = Time([&] { array(in.data(), actual.data(), num_inputs); });
+  Report(name, expected, actual, scalar_ns, array_ns);
+}
+
+void Binary(const char* name, ScalarPair scalar, ArrayPair array,
+            function<double(double)> draw_y, double low, double high) {
+  uniform_real_distribution<double> distribution(low, high);
+  vector<double> y(num_inputs), mu(num_inputs);
+  vector<double> expected(num_inputs), actual(num_inputs);
+  for (size_t i = 0; i < num_inputs; i++) {
+    mu[i] = distribution(generator);
+    y[i] = draw_y(mu[i]);
+  }
+  double scalar_ns = Time([&] {
+    for (size_t i = 0; i < num_inputs; i++)
+      expected[i] = scalar(y[i], mu[i]);
+  });
+  double array_ns = Time([&] {
+    array(y.data(), mu.data(), actual.data(), num_inputs);
+  });
+  Report(name, expected, actual, scalar_ns, array_ns);
+}
+
+#define UNARY(name, low, high)                                          \
+  Unary(#name, [](double x) { return name(x); },                        \
+        [](const double* in, double* out, size_t n) { name(in, out, n); }, \
+        low, high)
+
+#define KERNEL(name, reference, low, high)                              \
+  Unary("vector_math::" #name,                                          \
+        [](double x) { return (double) reference((long double) x); },   \
+        [](const double* in, double* out, size_t n) {                   \
+          vector_math::name(in, out, n);                                \
+        },                                                              \
+        low, high)
+
+#define BINARY(name, draw_y, low, high)                                 \
+  Binary(#name, [](double y, double mu) { return name(y, mu); },        \
+         [](const double* y, const double* mu, double* out, size_t n) {  \
+           name(y, mu, out, n);                                         \
+         },                                                             \
+         draw_y, low, high)
+
+int main(int argc, char** argv) {
+  if (argc > 1)
+    num_inputs = strtoul(argv[1], nullptr, 10);
+  if (argc > 2)
+    repetitions = atoi(argv[2]);
+
+  printf("AVX2 and FMA: %s\n", vector_math::internal::HasAVX2() ? "yes" : "no");
+  printf("%zu inputs, %d repetitions\n\n", num_inputs, repetitions);
+  printf("%-26s %8s %8s %8s %10s %10s %12s\n", "function", "scalar", "array",
+         "speedup", "max ULP", "max ULP", "max abs");
+  printf("%-26s %8s %8s %8s %10s %10s\n", "", "ns/elem", "ns/elem", "",
+         "of result", "of max(1,.)");
+
+  // Kernels, on the ranges used by the links and beyond.
+  KERNEL(Erf, erfl, -6, 6);
+  KERNEL(Erfc, erfcl, -6, 26);
+  KERNEL(ErfInv, boost::math::erf_inv, -1 + 1e-12, 1 - 1e-12);
+  KERNEL(Tan, tanl, -M_PI / 2, M_PI / 2);
+  KERNEL(Tan, tanl, -1e5, 1e5);
+  KERNEL(Atan, atanl, -1e6, 1e6);
+
+  // Links, on means in (0, 1).
+  UNARY(_identity, 0, 1);
+  UNARY(_inverse, 1e-3, 1);
+  UNARY(_inverseSquared, 1e-3, 1);
+  UNARY(_log, 1e-6, 1);
+  UNARY(_logit, 1e-6, 1 - 1e-6);
+  UNARY(_cloglog, 1e-6, 1 - 1e-6);
+  UNARY(_sqrt, 0, 1);
+  UNARY(_probit, 1e-6, 1 - 1e-6);
+  UNARY(_cauchit, 1e-6, 1 - 1e-6);
+
+  // Inverse links, on linear predictors in [-30, 30].
+  UNARY(inverse_identity, -30, 30);
+  UNARY(inverse_inverse, 1e-3, 30);
+  UNARY(inverse_inverseSquared, 1e-3, 30);
+  UNARY(inverse_log, -30, 30);
+  UNARY(inverse_logit, -30, 30);
+  UNARY(inverse_cloglog, -30, 30);
+  UNARY(inverse_sqrt, -30, 30);
+  UNARY(inverse_probit, -30, 30);
+  UNARY(inverse_cauchit, -30, 30);
+
+  // Derivatives of the links, on means in (0, 1).
+  UNARY(deriv_identity, 0, 1);
+  UNARY(deriv_inverse, 1e-3, 1);
+  UNARY(deriv_inverseSquared, 1e-3, 1);
+  UNARY(deriv_log, 1e-6, 1);
+  UNARY(deriv_logit, 1e-6, 1 - 1e-6);
+  UNARY(deriv_cloglog, 1e-6, 1 - 1e-6);
+  UNARY(deriv_sqrt, 1e-6, 1);
+  UNARY(deriv_probit, 1e-6, 1 - 1e-6);
+  UNARY(deriv_cauchit, 1e-6, 1 - 1e-6);
+
+  // Variances, on means in (0, 1).
+  UNARY(var_gaussian, 0, 1);
+  UNARY(var_binomial, 0, 1);
+  UNARY(var_poisson, 0, 1);
+  UNARY(var_exponential, 0, 1);
+  UNARY(var_gamma, 0, 1);
+  UNARY(var_inverseGaussian, 0, 1);
+  UNARY(var_negativeBinomial, 0, 1 - 1e-3);
+
+  // Deviances, with responses drawn from the family given the mean.
+  BINARY(deviance_gaussian, [](double mu) {
+    return normal_distribution<double>(mu, 1)(generator);
+  }, -30, 30);
+  BINARY(deviance_poisson, [](double mu) {
+    return (double) poisson_distribution<int>(mu)(generator);
+  }, 1e-3, 30);
+  BINARY(deviance_binomial, [](double mu) {
+    // Proportions of successes out of 0 to 4 trials, so that many are 0 or 1.
+    int trials = uniform_int_distribution<int>(1, 4)(generator);
+    return binomial_distribution<int>(trials, mu)(generator) / (double) trials;
+  }, 1e-6, 1 - 1e-6);
+  BINARY(deviance_gamma, [](double mu) {
+    return gamma_distribution<double>(2, mu / 2)(generator);
+  }, 1e-3, 30);
+  BINARY(deviance_inverseGaussian, [](double mu) {
+    return mu * exp(normal_distribution<double>(0, 0.5)(generator));
+  }, 1e-3, 30);
+
+  return 0;
+}
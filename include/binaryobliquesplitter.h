@@ -108,14 +108,47 @@ public:
     @param Dvars    discrete inputs
     @param Cvars    continuous inputs
   */
-  double ProbabilityLeft(const arma::ivec Dvars, const arma::vec Cvars) {
+  double ProbabilityLeft(const arma::ivec& Dvars, const arma::vec& Cvars) {
     if (ProbabilityLeftPrivate(Dvars, Cvars) > 0.5)
       return 1.0;
     else
       return 0.0;
   }
 
-  int ChooseBranch( const arma::ivec Dvars, const arma::vec Cvars) {
+  /** Compute the probability to take the left branch for a block of inputs.
+    For an oblique split, the criteria of all the inputs are computed with a
+    single matrix-vector product.
+    @param Dvars    discrete inputs, one column per input
+    @param Cvars    continuous inputs, one column per input
+    @param indices  the columns of the inputs to consider
+  */
+  arma::vec ProbabilityLeft(const arma::imat& Dvars, const arma::mat& Cvars,
+                            const arma::uvec& indices) {
+    arma::vec crit(indices.n_elem);
+    if (SplitVariable == -1) {
+      // split on a hyperplane
+      crit = Cvars.cols(indices).t()
+           * SeparatingHyperplane.subvec(1, csplitDim + regDim);
+      crit += SeparatingHyperplane[0];
+    } else if (SplitVariable <= -2) {
+      // split on a continuous variable
+      for (arma::uword i = 0; i < indices.n_elem; i++)
+        crit[i] = SeparatingHyperplane[0]
+                + Cvars(-SplitVariable - 2, indices[i])
+                * SeparatingHyperplane[-SplitVariable - 1];
+    } else {
+      // split on a discrete variable
+      arma::vec prob(indices.n_elem);
+      for (arma::uword i = 0; i < indices.n_elem; i++)
+        prob[i] = splitSetProbability[Dvars(SplitVariable, indices[i])] > 0.5;
+      return prob;
+    }
+    for (arma::uword i = 0; i < indices.n_elem; i++)
+      crit[i] = 1.0 - PValueNormalDistribution(0.0, 1.0, crit[i]) > 0.5;
+    return crit;
+  }
+
+  int ChooseBranch(const arma::ivec& Dvars, const arma::vec& Cvars) {
     if (ProbabilityLeftPrivate(Dvars, Cvars) > 0.5)
       return 0;
     else
@@ -133,7 +166,7 @@ public:
     continuousStatistics.Resize(csplitDim+regDim);
   }
 
-  void UpdateSplitStatistics(const arma::ivec Dvars, const arma::vec Cvars,
+  void UpdateSplitStatistics(const arma::ivec& Dvars, const arma::vec& Cvars,
                              double p1I, double p2I, double probability) {
     N++;
 
@@ -209,7 +242,7 @@ public:
     @param Dvars    discrete inputs
     @param Cvars    continuous inputs
   */
-  double ProbabilityLeftPrivate(const arma::ivec Dvars, const arma::vec Cvars) {
+  double ProbabilityLeftPrivate(const arma::ivec& Dvars, const arma::vec& Cvars) {
     // use the fact that SeparatingHyperplane is normalized
     if (SplitVariable == -1) {
       // split on a hyperplane
@@ -41,6 +41,7 @@ THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "regressiontree.h"
 #include "binaryregressiontreenode.h"
+#include "flatregressiontree.h"
 
 namespace CLUS {
 
@@ -166,6 +167,19 @@ class BinaryRegressionTree : public RegressionTree {
     root->LearnSample(dVars, cVars, probability, threshold);
   }
 
+  // Learns a block of samples, which are the columns of dVars and cVars. This
+  // is equivalent to learning each sample in turn.
+  virtual void LearnBlock(
+      const DiscreteMatrix& dVars,
+      const ContinuousMatrix& cVars,
+      double probability = 1.0) override {
+    const SizeType count = cVars.n_cols;
+    if (count == 0 || probability < threshold)
+      return;
+    root->LearnBlock(dVars, cVars, arma::regspace<arma::uvec>(0, count - 1),
+                     probability * arma::ones<arma::vec>(count), threshold);
+  }
+
   virtual void Merge(const TreeType& other) {
     root->Merge(*(other.root));
   }
@@ -204,6 +218,15 @@ class BinaryRegressionTree : public RegressionTree {
     return root->Infer(dVars, cVars, maxNodeID, infer_threshold);
   }
 
+  // Compiles the trained tree into a flat representation for fast inference.
+  FlatRegressionTree Flatten() const {
+    if (!root) {
+      throw std::logic_error("Attempting to flatten empty tree");
+    }
+
+    return FlatRegressionTree(*root, csplitDim, regDim);
+  }
+
   virtual Json::Value ToJson() const {
     return root->ToJson();
   }
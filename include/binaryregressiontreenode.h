@@ -68,6 +68,10 @@ class BinaryRegressionTreeNode {
   using DiscreteValue = arma::sword;
   using DiscreteVector = arma::ivec;
 
+  using ContinuousMatrix = arma::mat;
+  using DiscreteMatrix = arma::imat;
+  using IndexVector = arma::uvec;
+
   using ConfigType = typename ExpectMaxer::ConfigType;
 
  private:
@@ -206,7 +210,6 @@ class BinaryRegressionTreeNode {
     return nodeId;
   }
 
- private:
   bool IsLeaf() const {
     for (const auto& child : Children)
       if (child)
@@ -214,7 +217,22 @@ class BinaryRegressionTreeNode {
     return true;
   }
 
- public:
+  // The following are used to flatten a trained tree.
+
+  // Get the child of an intermediate node, 0 for left and 1 for right
+  const NodeType& GetChild(SizeType branch) const {
+    return *Children[branch];
+  }
+
+  const T_Splitter& GetSplitter() const {
+    return splitter;
+  }
+
+  // Get the regressor of this node, which is null until it is trained
+  const Regressor* GetRegressor() const {
+    return regressor.get();
+  }
+
   // Compute the size of the tree
   //
   // @param nodes     output variable where total number of nodes is placed
@@ -259,14 +277,11 @@ class BinaryRegressionTreeNode {
   // @param threshold   minimum probability to follow a branch
   void LearnSample(const DiscreteVector& Dvars, const ContinuousVector& Cvars,
                    double probability, double threshold = .01) {
-    double p0, p1, probLeft, probRight;
+    double probLeft, probRight;
 
     if (probability < threshold)
       return;
 
-    // Regression-only continuous variables
-    auto regVars = Cvars.subvec(csDim, Cvars.n_elem - 1);
-
     switch (state) {
       case State::stable:
         // Pass the sample to the right child
@@ -284,6 +299,78 @@ class BinaryRegressionTreeNode {
           Children[1]->LearnSample(Dvars, Cvars, probRight, threshold);
 
         break;
+      default:
+        Learn(Dvars, Cvars, probability);
+        break;
+    }
+  }
+
+  // Learn a block of data samples. Each node handles all of the samples that
+  // reach it before passing them on: the split is computed for the whole block
+  // at once by the splitter and the samples are forwarded to the children as
+  // lists of columns and weights, so the samples themselves are never copied.
+  //
+  // @param Dvars     input discrete variables, one column per sample
+  // @param Cvars     input continuous variables, one column per sample
+  // @param indices   columns of the samples that reach this node
+  // @param probabilities   weights of these samples
+  // @param threshold   minimum probability to follow a branch
+  void LearnBlock(const DiscreteMatrix& Dvars, const ContinuousMatrix& Cvars,
+                  const IndexVector& indices, const ContinuousVector& probabilities,
+                  double threshold = .01) {
+    if (indices.is_empty())
+      return;
+
+    switch (state) {
+      case State::stable: {
+        if (IsLeaf())
+          return;
+
+        ContinuousVector probLeft = probabilities
+                                  % splitter.ProbabilityLeft(Dvars, Cvars, indices);
+        ContinuousVector probRight = probabilities - probLeft;
+
+        IndexVector left = arma::find(probLeft >= threshold);
+        IndexVector right = arma::find(probRight >= threshold);
+
+        Children[0]->LearnBlock(Dvars, Cvars, indices.elem(left),
+                                probLeft.elem(left), threshold);
+        Children[1]->LearnBlock(Dvars, Cvars, indices.elem(right),
+                                probRight.elem(right), threshold);
+        break;
+      }
+      default:
+        // The statistics are still updated one sample at a time, using vectors
+        // that alias the columns of the block.
+        for (SizeType i = 0; i < indices.n_elem; i++) {
+          if (probabilities[i] < threshold)
+            continue;
+
+          SizeType column = indices[i];
+          const DiscreteVector dVars(
+              const_cast<DiscreteValue*>(Dvars.colptr(column)), Dvars.n_rows,
+              false, true);
+          const ContinuousVector cVars(
+              const_cast<ContinuousValue*>(Cvars.colptr(column)), Cvars.n_rows,
+              false, true);
+          Learn(dVars, cVars, probabilities[i]);
+        }
+        break;
+    }
+  }
+
+ private:
+  // Updates the statistics of a node that is not stable with a sample.
+  void Learn(const DiscreteVector& Dvars, const ContinuousVector& Cvars,
+             double probability) {
+    double p0, p1;
+
+    // Regression-only continuous variables, which alias the end of Cvars.
+    const ContinuousVector regVars(
+        const_cast<ContinuousValue*>(Cvars.memptr()) + csDim,
+        Cvars.n_elem - csDim, false, true);
+
+    switch (state) {
       case State::em:
         expectMaxer->learn(regVars, probability);
         break;
@@ -298,9 +385,12 @@ class BinaryRegressionTreeNode {
       case State::regression:
         overallDist.Update(regVars, probability);
         break;
+      case State::stable:
+        break;
     }
   }
 
+ public:
   // Used for merging two binary regression trees node-by-node.
   void Merge(const NodeType& other) {
     switch (state) {
@@ -427,7 +517,7 @@ class BinaryRegressionTreeNode {
                                double probability, double threshold) {
     // pruningTotalMass += probability;
 
-    double predY = regressor->Predict(Cvars + csDim);
+    double predY = regressor->Predict(Cvars.subvec(csDim, Cvars.n_elem - 1));
     pruningCost += (y - predY) * (y - predY) * probability;
 
     // update pruning statistics for the proper children
@@ -487,7 +577,7 @@ class BinaryRegressionTreeNode {
                SizeType maxNodeId, double threshold) {
     if (IsLeaf() || nodeId > maxNodeId) {
       // leaf node or level cut
-      return regressor->Predict(Cvars + csDim);
+      return regressor->Predict(Cvars.subvec(csDim, Cvars.n_elem - 1));
       //return nodeId;
     } else {
       double pChild1 = splitter.ProbabilityLeft(Dvars, Cvars);
@@ -122,6 +122,21 @@ class BinarySplitter {
     return dDomainSize;
   }
 
+  // Get the variable that is split on, -1 for an oblique split
+  inline int GetSplitVariable() const {
+    return SplitVariable;
+  }
+
+  // Get the separating hyperplane of a split on continuous variables
+  inline const arma::vec& GetSeparatingHyperplane() const {
+    return SeparatingHyperplane;
+  }
+
+  // Get the probabilities of the left partition of a split on a discrete variable
+  inline const arma::vec& GetSplitSetProbability() const {
+    return splitSetProbability;
+  }
+
   /** Decides what branch to to follow.
   @param Dvars    discrete inputs
   @param Cvars    continuous inputs
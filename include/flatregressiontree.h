@@ -0,0 +1,247 @@
+// A flattened representation of a trained BinaryRegressionTree, used for fast
+// inference. The nodes are stored in breadth-first order as a structure of
+// arrays, so that the children of a node are adjacent and each kind of data is
+// contiguous. A prediction follows a single path from the root, as the splits
+// are deterministic, and evaluates the linear regressor at its end inline. No
+// virtual calls are made, and memory is only allocated once per block by the
+// block versions.
+//
+// The predictions are the same as those of BinaryRegressionTree::Infer, which
+// also follows a single path and evaluates the regressor of the node reached on
+// the regression variables, i.e. the entries of the continuous vector following
+// the split variables.
+
+#ifndef _CLUS_FLATREGRESSIONTREE_H_
+#define _CLUS_FLATREGRESSIONTREE_H_
+
+#include <armadillo>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace CLUS {
+
+class FlatRegressionTree {
+ public:
+  using SizeType = std::size_t;
+
+  using ContinuousValue = double;
+  using DiscreteValue = arma::sword;
+
+ private:
+  // the number of continuous split variables
+  SizeType csDim;
+
+  // the number of regressors
+  SizeType regDim;
+
+  // the number of nodes in the tree
+  SizeType numNodes;
+
+  // the ID of each node in the original tree, used to limit the depth
+  arma::uvec ids;
+
+  // the position of the left child of each node, the right child following it.
+  // It is 0 for leaves, as the root is never a child.
+  arma::uvec left;
+
+  // the variable each node splits on, encoded as in BinarySplitter: -1 for an
+  // oblique split, -k - 2 for a split on the kth continuous variable and k for
+  // a split on the kth discrete variable
+  arma::ivec variable;
+
+  // the separating hyperplanes of the splits on continuous variables, one
+  // column per node
+  arma::mat planes;
+
+  // for the splits on discrete variables, the position in sets of the first
+  // value of the variable
+  arma::uvec offsets;
+
+  // whether each value of a discrete variable goes to the left child, with the
+  // values of every node concatenated
+  arma::uvec sets;
+
+  // the coefficients of the regressor of each node, intercept first, one column
+  // per node. Missing coefficients are 0.
+  arma::mat coefficients;
+
+ public:
+  // Compiles a trained tree. Intermediate nodes are kept as well as leaves, as
+  // the prediction can be stopped before reaching a leaf.
+  //
+  // @param root      the root of the trained tree
+  // @param CsDim     number of split variables
+  // @param RegDim    number of regressor variables
+  template<class T_Node>
+  FlatRegressionTree(const T_Node& root, SizeType CsDim, SizeType RegDim)
+      : csDim(CsDim),
+        regDim(RegDim) {
+    // list the nodes in breadth-first order
+    std::vector<const T_Node*> order{&root};
+    for (SizeType n = 0; n < order.size(); n++) {
+      if (!order[n]->IsLeaf()) {
+        order.push_back(&order[n]->GetChild(0));
+        order.push_back(&order[n]->GetChild(1));
+      }
+    }
+
+    numNodes = order.size();
+    ids.zeros(numNodes);
+    left.zeros(numNodes);
+    variable.zeros(numNodes);
+    planes.zeros(csDim + regDim + 1, numNodes);
+    offsets.zeros(numNodes);
+    coefficients.zeros(regDim + 1, numNodes);
+
+    std::vector<arma::uword> allSets;
+    SizeType next = 1;
+    for (SizeType n = 0; n < numNodes; n++) {
+      const T_Node& node = *order[n];
+      ids[n] = node.GetNodeId();
+
+      const auto regressor = node.GetRegressor();
+      if (!regressor)
+        throw std::logic_error("Attempting to flatten untrained tree");
+      arma::vec coef = regressor->GetCoefficients();
+      if (coef.n_elem > regDim + 1)
+        throw std::logic_error("Regressor has too many coefficients");
+      coefficients.col(n).head(coef.n_elem) = coef;
+
+      if (node.IsLeaf())
+        continue;
+
+      left[n] = next;
+      next += 2;
+
+      const auto& splitter = node.GetSplitter();
+      variable[n] = splitter.GetSplitVariable();
+      if (variable[n] >= 0) {
+        offsets[n] = allSets.size();
+        for (double probability : splitter.GetSplitSetProbability())
+          allSets.push_back(probability > 0.5);
+      } else {
+        const arma::vec& plane = splitter.GetSeparatingHyperplane();
+        if (plane.n_elem > csDim + regDim + 1)
+          throw std::logic_error("Hyperplane has too many coefficients");
+        planes.col(n).head(plane.n_elem) = plane;
+      }
+    }
+
+    sets = arma::conv_to<arma::uvec>::from(allSets);
+  }
+
+  SizeType GetNumNodes() const {
+    return numNodes;
+  }
+
+  // Finds the node at which the prediction is made, which is either a leaf or
+  // the first node on the path whose ID exceeds maxNodeId.
+  //
+  // @param Dvars     input discrete variables
+  // @param Cvars     input continuous variables, split variables first
+  // @param maxNodeId   maximum ID of a node to propagate to
+  SizeType Route(const DiscreteValue* Dvars, const ContinuousValue* Cvars,
+                 SizeType maxNodeId = std::numeric_limits<SizeType>::max()) const {
+    SizeType node = 0;
+    while (left[node] != 0 && ids[node] <= maxNodeId)
+      node = left[node] + (GoLeft(node, Dvars, Cvars) ? 0 : 1);
+    return node;
+  }
+
+  // Finds the node at which the prediction is made for a block of inputs,
+  // stored as the columns of Dvars and Cvars. The inputs are routed together,
+  // one level at a time, so that the paths of different inputs are followed
+  // in an interleaved manner rather than one after the other.
+  //
+  // @param Dvars     input discrete variables, one column per input
+  // @param Cvars     input continuous variables, one column per input
+  // @param nodes     output vector, set to the node of each input
+  // @param maxNodeId   maximum ID of a node to propagate to
+  void Route(const arma::imat& Dvars, const arma::mat& Cvars, arma::uvec& nodes,
+             SizeType maxNodeId = std::numeric_limits<SizeType>::max()) const {
+    SizeType count = Cvars.n_cols;
+    nodes.zeros(count);
+    // the inputs that may not have reached their node yet
+    std::vector<SizeType> active(count);
+    for (SizeType i = 0; i < count; i++)
+      active[i] = i;
+    while (!active.empty()) {
+      SizeType remaining = 0;
+      for (SizeType i : active) {
+        SizeType node = nodes[i];
+        if (left[node] == 0 || ids[node] > maxNodeId)
+          continue;
+        nodes[i] = left[node]
+                 + (GoLeft(node, Dvars.colptr(i), Cvars.colptr(i)) ? 0 : 1);
+        active[remaining++] = i;
+      }
+      active.resize(remaining);
+    }
+  }
+
+  // Does the inference
+  //
+  // @param Dvars     input discrete variables
+  // @param Cvars     input continuous variables, split variables first
+  // @param maxNodeId   maximum ID of a node to propagate to
+  ContinuousValue Predict(const DiscreteValue* Dvars, const ContinuousValue* Cvars,
+                          SizeType maxNodeId = std::numeric_limits<SizeType>::max()) const {
+    const double* coef = coefficients.colptr(Route(Dvars, Cvars, maxNodeId));
+    const ContinuousValue* regVars = Cvars + csDim;
+    double result = coef[0];
+    for (SizeType i = 0; i < regDim; i++)
+      result += coef[i + 1] * regVars[i];
+    return result;
+  }
+
+  // Does the inference for a block of inputs, stored as the columns of Dvars
+  // and Cvars. The inputs are routed together and the regressors of their
+  // nodes are then gathered and evaluated at once.
+  //
+  // @param Dvars     input discrete variables, one column per input
+  // @param Cvars     input continuous variables, one column per input
+  // @param result    output vector, which must have one element per input
+  // @param maxNodeId   maximum ID of a node to propagate to
+  void Predict(const arma::imat& Dvars, const arma::mat& Cvars, arma::vec& result,
+               SizeType maxNodeId = std::numeric_limits<SizeType>::max()) const {
+    arma::uvec nodes;
+    Route(Dvars, Cvars, nodes, maxNodeId);
+    arma::mat gathered = coefficients.cols(nodes);
+    result = gathered.row(0).t();
+    if (regDim > 0)
+      result += arma::sum(gathered.tail_rows(regDim)
+                          % Cvars.rows(csDim, csDim + regDim - 1), 0).t();
+  }
+
+ private:
+  // Whether an input goes to the left child of a node that is not a leaf.
+  //
+  // @param node      the position of the node
+  // @param Dvars     input discrete variables
+  // @param Cvars     input continuous variables, split variables first
+  bool GoLeft(SizeType node, const DiscreteValue* Dvars,
+              const ContinuousValue* Cvars) const {
+    int split = variable[node];
+    if (split >= 0) {
+      // split on a discrete variable
+      return sets[offsets[node] + Dvars[split]];
+    }
+    // The left branch is taken when the criterion is positive, which is when
+    // the probability computed by BinaryObliqueSplitter exceeds 0.5.
+    const double* plane = planes.colptr(node);
+    double crit = plane[0];
+    if (split == -1) {
+      for (SizeType i = 0; i < csDim + regDim; i++)
+        crit += plane[i + 1] * Cvars[i];
+    } else {
+      crit += plane[-split - 1] * Cvars[-split - 2];
+    }
+    return crit > 0;
+  }
+};
+
+}
+
+#endif // _CLUS_FLATREGRESSIONTREE_H_
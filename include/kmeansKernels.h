@@ -0,0 +1,258 @@
+// These functions are used to assign a point to its nearest cluster center in
+// single precision. Armadillo does not vectorize the pattern of subtracting the
+// point from each center and then summing the squares, so the distances and the
+// arg-min are instead computed using explicit AVX2 or AVX-512 instructions. The
+// instruction set is chosen at runtime based on the CPU, with a scalar version
+// used when neither is available.
+//
+// The centers are stored dimension-major so that consecutive centers occupy
+// consecutive SIMD lanes: the j-th coordinate of center c is located at
+// centers[j * stride + c]. The stride is a multiple of kCenterAlignment and the
+// padding centers are never returned.
+//
+// The categorical modes used by k-prototypes are stored as integer codes, one
+// per factor, with each mode occupying a contiguous run of CodeStride codes.
+// The mismatches between an item and every mode are counted by comparing whole
+// registers of codes at once and taking the population count of the result.
+
+#ifndef _KMEANS_KERNELS_H_
+#define _KMEANS_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <immintrin.h>
+
+namespace kmeans_kernels {
+
+// The stride of the centers must be a multiple of this, the number of floats in
+// the widest register used.
+constexpr const std::size_t kCenterAlignment = 16;
+
+// Rounds the number of centers up to a valid stride.
+constexpr std::size_t Stride(std::size_t num_centers) {
+  return (num_centers + kCenterAlignment - 1) / kCenterAlignment
+       * kCenterAlignment;
+}
+
+// Computes the squared Euclidean distance between the point and each center and
+// returns the index of the nearest center. Ties are broken in favor of the lower
+// index. The distances are written to the buffer, which must hold stride floats.
+typedef std::size_t (*NearestCenter)(const float* point, const float* centers,
+                                     std::size_t dimension,
+                                     std::size_t num_centers,
+                                     std::size_t stride, float* distances);
+
+inline std::size_t NearestCenterScalar(
+    const float* point, const float* centers, std::size_t dimension,
+    std::size_t num_centers, std::size_t stride, float* distances) {
+  for (std::size_t c = 0; c < num_centers; c++)
+    distances[c] = 0;
+  for (std::size_t j = 0; j < dimension; j++) {
+    const float* row = centers + j * stride;
+    for (std::size_t c = 0; c < num_centers; c++) {
+      float difference = row[c] - point[j];
+      distances[c] += difference * difference;
+    }
+  }
+  std::size_t nearest = 0;
+  for (std::size_t c = 1; c < num_centers; c++)
+    if (distances[c] < distances[nearest])
+      nearest = c;
+  return nearest;
+}
+
+__attribute__((target("avx2,fma")))
+inline std::size_t NearestCenterAVX2(
+    const float* point, const float* centers, std::size_t dimension,
+    std::size_t num_centers, std::size_t stride, float* distances) {
+  for (std::size_t c = 0; c < stride; c += 8)
+    _mm256_storeu_ps(distances + c, _mm256_setzero_ps());
+  for (std::size_t j = 0; j < dimension; j++) {
+    const float* row = centers + j * stride;
+    __m256 coordinate = _mm256_set1_ps(point[j]);
+    for (std::size_t c = 0; c < stride; c += 8) {
+      __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(row + c), coordinate);
+      _mm256_storeu_ps(distances + c,
+                       _mm256_fmadd_ps(difference, difference,
+                                       _mm256_loadu_ps(distances + c)));
+    }
+  }
+  // The padding is made infinite so that it is never the minimum.
+  for (std::size_t c = num_centers; c < stride; c++)
+    distances[c] = std::numeric_limits<float>::infinity();
+
+  // Each lane keeps the minimum and its index over the centers in that lane.
+  // A strict comparison means each lane keeps its earliest minimum.
+  __m256 minimum = _mm256_loadu_ps(distances);
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i current = index;
+  __m256i step = _mm256_set1_epi32(8);
+  for (std::size_t c = 8; c < stride; c += 8) {
+    current = _mm256_add_epi32(current, step);
+    __m256 values = _mm256_loadu_ps(distances + c);
+    __m256 less = _mm256_cmp_ps(values, minimum, _CMP_LT_OQ);
+    minimum = _mm256_blendv_ps(minimum, values, less);
+    index = _mm256_blendv_epi8(index, current, _mm256_castps_si256(less));
+  }
+  alignas(32) float lane_minimum[8];
+  alignas(32) int lane_index[8];
+  _mm256_store_ps(lane_minimum, minimum);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lane_index), index);
+  std::size_t nearest = lane_index[0];
+  for (int lane = 1; lane < 8; lane++)
+    if (lane_minimum[lane] < distances[nearest]
+        || (lane_minimum[lane] == distances[nearest]
+            && (std::size_t) lane_index[lane] < nearest))
+      nearest = lane_index[lane];
+  return nearest;
+}
+
+__attribute__((target("avx512f")))
+inline std::size_t NearestCenterAVX512(
+    const float* point, const float* centers, std::size_t dimension,
+    std::size_t num_centers, std::size_t stride, float* distances) {
+  for (std::size_t c = 0; c < stride; c += 16)
+    _mm512_storeu_ps(distances + c, _mm512_setzero_ps());
+  for (std::size_t j = 0; j < dimension; j++) {
+    const float* row = centers + j * stride;
+    __m512 coordinate = _mm512_set1_ps(point[j]);
+    for (std::size_t c = 0; c < stride; c += 16) {
+      __m512 difference = _mm512_sub_ps(_mm512_loadu_ps(row + c), coordinate);
+      _mm512_storeu_ps(distances + c,
+                       _mm512_fmadd_ps(difference, difference,
+                                       _mm512_loadu_ps(distances + c)));
+    }
+  }
+  for (std::size_t c = num_centers; c < stride; c++)
+    distances[c] = std::numeric_limits<float>::infinity();
+
+  __m512 minimum = _mm512_loadu_ps(distances);
+  __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                    8, 9, 10, 11, 12, 13, 14, 15);
+  __m512i current = index;
+  __m512i step = _mm512_set1_epi32(16);
+  for (std::size_t c = 16; c < stride; c += 16) {
+    current = _mm512_add_epi32(current, step);
+    __m512 values = _mm512_loadu_ps(distances + c);
+    __mmask16 less = _mm512_cmp_ps_mask(values, minimum, _CMP_LT_OQ);
+    minimum = _mm512_mask_blend_ps(less, minimum, values);
+    index = _mm512_mask_blend_epi32(less, index, current);
+  }
+  alignas(64) float lane_minimum[16];
+  alignas(64) int lane_index[16];
+  _mm512_store_ps(lane_minimum, minimum);
+  _mm512_store_si512(lane_index, index);
+  std::size_t nearest = lane_index[0];
+  for (int lane = 1; lane < 16; lane++)
+    if (lane_minimum[lane] < distances[nearest]
+        || (lane_minimum[lane] == distances[nearest]
+            && (std::size_t) lane_index[lane] < nearest))
+      nearest = lane_index[lane];
+  return nearest;
+}
+
+// Picks the fastest version supported by the CPU that the code is running on.
+inline NearestCenter SelectNearestCenter() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return NearestCenterAVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return NearestCenterAVX2;
+  return NearestCenterScalar;
+}
+
+// The length in bytes of each mode must be a multiple of this, the number of
+// bytes in the widest register used.
+constexpr const std::size_t kCodeAlignment = 64;
+
+// Rounds the number of factors up to a valid length for a mode, in codes.
+template<class Code>
+constexpr std::size_t CodeStride(std::size_t num_factors) {
+  return (num_factors * sizeof(Code) + kCodeAlignment - 1) / kCodeAlignment
+       * kCodeAlignment / sizeof(Code);
+}
+
+// Counts the number of codes in which the item differs from each mode. The item
+// and each mode hold stride codes and must agree on the padding, which is then
+// never counted. The modes are laid out consecutively. Codes are either 8 or 16
+// bits wide, depending on the largest cardinality of the factors.
+template<class Code>
+using Mismatches = void (*)(const Code* item, const Code* modes,
+                            std::size_t stride, std::size_t num_centers,
+                            std::uint32_t* counts);
+
+template<class Code>
+inline void MismatchesScalar(const Code* item, const Code* modes,
+                             std::size_t stride, std::size_t num_centers,
+                             std::uint32_t* counts) {
+  for (std::size_t c = 0; c < num_centers; c++, modes += stride) {
+    std::uint32_t count = 0;
+    for (std::size_t j = 0; j < stride; j++)
+      count += item[j] != modes[j];
+    counts[c] = count;
+  }
+}
+
+template<class Code>
+__attribute__((target("avx2,popcnt")))
+inline void MismatchesAVX2(const Code* item, const Code* modes,
+                           std::size_t stride, std::size_t num_centers,
+                           std::uint32_t* counts) {
+  static_assert(sizeof(Code) <= 2, "Codes must be at most 16 bits wide.");
+  const char* item_bytes = reinterpret_cast<const char*>(item);
+  const char* mode_bytes = reinterpret_cast<const char*>(modes);
+  std::size_t length = stride * sizeof(Code);
+  for (std::size_t c = 0; c < num_centers; c++, mode_bytes += length) {
+    // The mask has a bit per byte, so that a 16 bit code has two equal bits.
+    std::uint32_t equal = 0;
+    for (std::size_t j = 0; j < length; j += 32) {
+      __m256i x = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(item_bytes + j));
+      __m256i y = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(mode_bytes + j));
+      __m256i result = sizeof(Code) == 1 ? _mm256_cmpeq_epi8(x, y)
+                                         : _mm256_cmpeq_epi16(x, y);
+      equal += __builtin_popcount(_mm256_movemask_epi8(result));
+    }
+    counts[c] = (length - equal) / sizeof(Code);
+  }
+}
+
+template<class Code>
+__attribute__((target("avx512f,avx512bw,popcnt")))
+inline void MismatchesAVX512(const Code* item, const Code* modes,
+                             std::size_t stride, std::size_t num_centers,
+                             std::uint32_t* counts) {
+  static_assert(sizeof(Code) <= 2, "Codes must be at most 16 bits wide.");
+  const char* item_bytes = reinterpret_cast<const char*>(item);
+  const char* mode_bytes = reinterpret_cast<const char*>(modes);
+  std::size_t length = stride * sizeof(Code);
+  for (std::size_t c = 0; c < num_centers; c++, mode_bytes += length) {
+    std::uint32_t count = 0;
+    for (std::size_t j = 0; j < length; j += 64) {
+      __m512i x = _mm512_loadu_si512(item_bytes + j);
+      __m512i y = _mm512_loadu_si512(mode_bytes + j);
+      // The mask has a bit per code.
+      count += sizeof(Code) == 1
+             ? __builtin_popcountll(_mm512_cmpneq_epi8_mask(x, y))
+             : __builtin_popcount(_mm512_cmpneq_epi16_mask(x, y));
+    }
+    counts[c] = count;
+  }
+}
+
+// Picks the fastest version supported by the CPU that the code is running on.
+template<class Code>
+inline Mismatches<Code> SelectMismatches() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("popcnt"))
+    return MismatchesAVX512<Code>;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    return MismatchesAVX2<Code>;
+  return MismatchesScalar<Code>;
+}
+
+}
+
+#endif // _KMEANS_KERNELS_H_
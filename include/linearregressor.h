@@ -84,6 +84,10 @@ class LinearRegressor: public Regressor {
     return new LinearRegressor(*this);
   }
 
+  virtual arma::vec GetCoefficients() const override {
+    return arma::join_cols(arma::vec({intercept}), beta);
+  }
+
   virtual Json::Value ToJson() const override {
     Json::Value ret;
     ret.append(intercept);
@@ -45,6 +45,8 @@ public:
   using ContinuousVector = arma::vec;
   using DiscreteValue = arma::sword;
   using DiscreteVector = arma::ivec;
+  using ContinuousMatrix = arma::mat;
+  using DiscreteMatrix = arma::imat;
 
   virtual ~RegressionTree() {}
 
@@ -52,6 +54,10 @@ public:
 	virtual void LearnSample(
       const DiscreteVector& dVars,
       const ContinuousVector& cVars,
+      const double probability = 1.0) = 0;
+	virtual void LearnBlock(
+      const DiscreteMatrix& dVars,
+      const ContinuousMatrix& cVars,
       const double probability = 1.0) = 0;
 	virtual bool StopLearningRound(void) = 0;
 
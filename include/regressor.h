@@ -49,6 +49,10 @@ class Regressor {
 
   virtual Regressor* clone(void) const = 0;
 
+  // The coefficients of the regressor, with the intercept first. This is used
+  // to evaluate the regressor without virtual calls, e.g. in a flattened tree.
+  virtual arma::vec GetCoefficients() const = 0;
+
   virtual Json::Value ToJson() const = 0;
 };
 }
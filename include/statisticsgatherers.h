@@ -530,7 +530,7 @@ class MultidimNormalStatistics {
     @param p1     probability for the datapoint to belong to first Gaussian
     @param p2     probability for the datapoint to belong to second Gaussian
   */
-  void UpdateStatistics(const arma::vec values, double p1, double p2) {
+  void UpdateStatistics(const arma::vec& values, double p1, double p2) {
     if (!finite(p1 + p2))
       return;
 
@@ -0,0 +1,540 @@
+// These functions apply elementary and special functions to arrays of doubles.
+// They are meant for hot loops that would otherwise call std::exp, std::log,
+// std::erf and the like once per element, which the compiler cannot vectorize. When the CPU supports AVX2 and
+// FMA, four elements are processed at once using polynomial approximations;
+// otherwise, the standard library is called for each element. The version used
+// is chosen at runtime.
+//
+// Accuracy of the AVX2 versions, measured against glibc over 10^7 random inputs
+// spanning the domain:
+//   Exp: at most 2 ULP, subnormal results included. As with std::exp, inputs
+//        above about 709.78 give infinity, inputs below about -708.40 give
+//        subnormal results and inputs below about -745.13 give zero. NaN is
+//        kept.
+//   Log: at most 3 ULP for positive normal inputs. Zero, negative, subnormal and
+//        non-finite inputs are not supported.
+//   Pow: computed as Exp(exponent * Log(x)); the relative error is at most
+//        about 2 ULP plus |exponent * log(x)| ULP.
+// and against the long double versions, or boost::math::erf_inv for ErfInv,
+// over 4 * 10^6 random inputs per range:
+//   Erf:    at most 2 ULP.
+//   Erfc:   at most 5 ULP for normal results, as for x in [-6, 26.5]. Larger
+//           inputs give subnormal results and then zero, as with std::erfc.
+//   ErfInv: at most 4 ULP over (-1, 1), including the inputs within 2^-53 of
+//           +-1. Inputs of +-1 and beyond are not supported.
+//   Tan:    at most 4 ULP for |x| <= 2^20. Larger inputs are not supported.
+//   Atan:   at most 3 ULP.
+// Every function may be called in place, i.e. with in == out.
+
+#ifndef _VECTOR_MATH_H_
+#define _VECTOR_MATH_H_
+
+#include <cmath>
+#include <cstddef>
+#include <immintrin.h>
+
+namespace vector_math {
+
+namespace internal {
+
+// Coefficients of the Taylor series of exp(r) for |r| <= ln(2) / 2. The terms
+// past the 12th are below 2^-53 relative to the result.
+constexpr const double kExp[13] = {
+  1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040,
+  1.0 / 40320, 1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600
+};
+
+// ln(2) split into a high part with trailing zeros, so that n * kLn2High is
+// exact for the range of n used, and the remainder.
+constexpr const double kLn2High = 6.93147180369123816490e-01;
+constexpr const double kLn2Low  = 1.90821492927058770002e-10;
+constexpr const double kLog2E   = 1.44269504088896338700e+00;
+
+// Adding this to a double in [-2^51, 2^51] rounds it to an integer stored in
+// the low bits of the mantissa.
+constexpr const double kRoundMagic = 6755399441055744.0;
+
+// Coefficients of a polynomial p in t = (x - 3) / (x + 3) such that erfc(x) =
+// exp(-x^2) * p(t) / (1 + 2x) for x >= 0. They were found by interpolation at
+// 23 Chebyshev nodes for x in [0, 27.3], past which erfc(x) underflows, and
+// p(t) is within 2 ULP of its exact value on that range.
+constexpr const double kErfc[23] = {
+  1.2530080582697296, -0.13562110612458067, -0.047562294353446846,
+  0.12964515870270404, -0.11927366341550479, 0.06830802734585574,
+  -0.023770514914689324, 0.0025293917874392321, 0.0018886903163987221,
+  -0.00077983203042845538, -0.00010515951430802023, 0.00012509811046590528,
+  4.948225243188312e-06, -2.0096488951806807e-05, -7.2773316931892048e-07,
+  3.4636901087184284e-06, 3.4913253432206377e-07, -6.0459806713366929e-07,
+  -1.3114298770307867e-07, 9.1562442314349847e-08, 3.2852433981759875e-08,
+  -8.405721805214884e-09, -4.1709678137948293e-09
+};
+
+// Coefficients of the Taylor series of erf(x) / x in x^2, i.e. 2 / sqrt(pi)
+// times (-1)^n / (n! * (2n + 1)). For |x| < 0.75, the terms past the 16th are
+// below 2^-53 relative to the result.
+constexpr const double kErf[16] = {
+  M_2_SQRTPI, -M_2_SQRTPI / 3, M_2_SQRTPI / 10, -M_2_SQRTPI / 42,
+  M_2_SQRTPI / 216, -M_2_SQRTPI / 1320, M_2_SQRTPI / 9360,
+  -M_2_SQRTPI / 75600, M_2_SQRTPI / 685440, -M_2_SQRTPI / 6894720,
+  M_2_SQRTPI / 76204800, -M_2_SQRTPI / 918086400, M_2_SQRTPI / 11975040000.0,
+  -M_2_SQRTPI / 168129561600.0, M_2_SQRTPI / 2528170444800.0,
+  -M_2_SQRTPI / 40537905408000.0
+};
+
+// Coefficients of polynomials approximating erf^-1(y) / y within 2 * 10^-7,
+// found by interpolation at Chebyshev nodes. With w = -log(1 - y^2), the first
+// is in w - 3.125 for w < 6.25 and the second is in sqrt(w) - 4.25 for w up to
+// 37.5, which covers every double in (-1, 1). One step of Halley's method then
+// refines the estimate to full precision.
+constexpr const double kErfInvCentral[10] = {
+  1.6536546892219326, 0.24015818157546034, -0.0060343210049491778,
+  -0.00074069788687764577, 0.00018727650058439143, -1.3887603892152655e-05,
+  -1.5271311865336488e-06, 4.2576940583914076e-07, -8.5279470613689399e-09,
+  -4.613402191017829e-09
+};
+constexpr const double kErfInvTail[10] = {
+  4.0922240383311195, 1.0099794856001896, 0.00070327901455693347,
+  -0.00061394019949718352, 0.00023666754763487503, -5.6801129777419517e-05,
+  -1.4925343322772558e-06, -1.2668449171911082e-05, 1.5630513796268688e-05,
+  -4.0319682230377626e-06
+};
+
+// pi / 2 split into two parts with 32 significant bits, so that n times either
+// is exact for |n| <= 2^20, and the remainder.
+constexpr const double kPiOver2High = 1.57079632673412561417e+00;
+constexpr const double kPiOver2Mid  = 6.07710050630396597660e-11;
+constexpr const double kPiOver2Low  = 2.02226624879595063154e-21;
+
+// Coefficients of the Taylor series of sin(r) / r and cos(r) in r^2. For
+// |r| <= pi / 4, the terms past the 10th are below 2^-53 relative to the
+// result.
+constexpr const double kSin[10] = {
+  1.0, -1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800,
+  1.0 / 6227020800.0, -1.0 / 1307674368000.0, 1.0 / 355687428096000.0,
+  -1.0 / 121645100408832000.0
+};
+constexpr const double kCos[10] = {
+  1.0, -1.0 / 2, 1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800,
+  1.0 / 479001600, -1.0 / 87178291200.0, 1.0 / 20922789888000.0,
+  -1.0 / 6402373705728000.0
+};
+
+// Coefficients of the Taylor series of atan(r) / r in r^2. For
+// |r| <= tan(pi / 16), the terms past the 13th are below 2^-53 relative to the
+// result.
+constexpr const double kAtan[13] = {
+  1.0, -1.0 / 3, 1.0 / 5, -1.0 / 7, 1.0 / 9, -1.0 / 11, 1.0 / 13, -1.0 / 15,
+  1.0 / 17, -1.0 / 19, 1.0 / 21, -1.0 / 23, 1.0 / 25
+};
+
+// tan((2j - 1) * pi / 16) for j = 1 to 4. Inputs between the (j - 1)th and jth
+// bounds are reduced about tan(j * pi / 8).
+constexpr const double kAtanBounds[4] = {
+  0.19891236737965801, 0.66817863791929888, 1.4966057626654889,
+  5.0273394921258481
+};
+constexpr const double kTanPiOver8  = 0.41421356237309503;
+constexpr const double kTan3PiOver8 = 2.4142135623730949;
+
+// pi / 8 split into a high part with trailing zeros, so that j * kPiOver8High
+// is exact for j <= 4, and the remainder.
+constexpr const double kPiOver8High = 3.92699081698724139500e-01;
+constexpr const double kPiOver8Low  = 1.53080849893419150897e-17;
+
+// Computes 2^n for integers n in [-1022, 1023], stored as doubles.
+__attribute__((target("avx2,fma")))
+inline __m256d PowerOfTwoAVX2(__m256d n) {
+  __m256i bits = _mm256_castpd_si256(
+      _mm256_add_pd(n, _mm256_set1_pd(kRoundMagic)));
+  bits = _mm256_add_epi64(bits, _mm256_set1_epi64x(1023));
+  return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d ExpAVX2(__m256d x) {
+  // The input is clamped to where the result is already infinite or zero. The
+  // bound is given first so that NaN is kept.
+  x = _mm256_min_pd(_mm256_set1_pd(710.0),
+                    _mm256_max_pd(_mm256_set1_pd(-746.0), x));
+  // x = n * ln(2) + r, where n is an integer and |r| <= ln(2) / 2.
+  __m256d shifted = _mm256_fmadd_pd(x, _mm256_set1_pd(kLog2E),
+                                    _mm256_set1_pd(kRoundMagic));
+  __m256d n = _mm256_sub_pd(shifted, _mm256_set1_pd(kRoundMagic));
+  __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(kLn2High), x);
+  r = _mm256_fnmadd_pd(n, _mm256_set1_pd(kLn2Low), r);
+  __m256d result = _mm256_set1_pd(kExp[12]);
+  for (int counter = 11; counter >= 0; counter--)
+    result = _mm256_fmadd_pd(result, r, _mm256_set1_pd(kExp[counter]));
+  // 2^n is outside of the normal range for the extreme inputs, so the result
+  // is scaled by 2^n1 and then by 2^n2, where n1 = floor(n / 2) and n2 = n - n1.
+  // The first product is exact and the second rounds once, which overflows or
+  // underflows gradually as std::exp does. Each power is constructed directly
+  // from its bits, as the low bits of n + kRoundMagic hold n.
+  __m256d n1 = _mm256_floor_pd(_mm256_mul_pd(n, _mm256_set1_pd(0.5)));
+  __m256d n2 = _mm256_sub_pd(n, n1);
+  // Underflowing to zero is slow on most CPUs, so the inputs that were clamped
+  // from below skip the second product and are set to zero instead.
+  __m256d zero = _mm256_cmp_pd(x, _mm256_set1_pd(-746.0), _CMP_EQ_OQ);
+  n2 = _mm256_andnot_pd(zero, n2);
+  result = _mm256_mul_pd(result, PowerOfTwoAVX2(n1));
+  result = _mm256_mul_pd(result, PowerOfTwoAVX2(n2));
+  return _mm256_andnot_pd(zero, result);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d LogAVX2(__m256d x) {
+  // x = m * 2^e, where m is in [1, 2).
+  __m256i bits = _mm256_castpd_si256(x);
+  __m256i exponent = _mm256_srli_epi64(bits, 52);
+  __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+      _mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+      _mm256_set1_epi64x(0x3ff0000000000000LL)));
+  // The biased exponent is converted to a double via the bits of 2^52 + e.
+  __m256d e = _mm256_sub_pd(
+      _mm256_castsi256_pd(_mm256_or_si256(
+          exponent, _mm256_set1_epi64x(0x4330000000000000LL))),
+      _mm256_set1_pd(4503599627370496.0 + 1023));
+  // m is moved into [sqrt(2) / 2, sqrt(2)) to minimize the series argument.
+  __m256d large = _mm256_cmp_pd(m, _mm256_set1_pd(M_SQRT2), _CMP_GE_OQ);
+  m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), large);
+  e = _mm256_add_pd(e, _mm256_and_pd(large, _mm256_set1_pd(1.0)));
+  // log(m) = 2 * atanh(f), where f = (m - 1) / (m + 1) and |f| < 0.1716.
+  __m256d f = _mm256_div_pd(_mm256_sub_pd(m, _mm256_set1_pd(1.0)),
+                            _mm256_add_pd(m, _mm256_set1_pd(1.0)));
+  __m256d f2 = _mm256_mul_pd(f, f);
+  __m256d series = _mm256_set1_pd(1.0 / 21);
+  for (int counter = 19; counter >= 1; counter -= 2)
+    series = _mm256_fmadd_pd(series, f2, _mm256_set1_pd(1.0 / counter));
+  __m256d log_m = _mm256_mul_pd(_mm256_add_pd(f, f), series);
+  __m256d result = _mm256_fmadd_pd(e, _mm256_set1_pd(kLn2Low), log_m);
+  return _mm256_fmadd_pd(e, _mm256_set1_pd(kLn2High), result);
+}
+
+// Computes erfc(a) for a >= 0.
+__attribute__((target("avx2,fma")))
+inline __m256d ErfcPositiveAVX2(__m256d a) {
+  // The input is clamped to where the result is already zero. The bound is
+  // given first so that NaN is kept.
+  a = _mm256_min_pd(_mm256_set1_pd(28.0), a);
+  __m256d t = _mm256_div_pd(_mm256_sub_pd(a, _mm256_set1_pd(3.0)),
+                            _mm256_add_pd(a, _mm256_set1_pd(3.0)));
+  __m256d p = _mm256_set1_pd(kErfc[22]);
+  for (int counter = 21; counter >= 0; counter--)
+    p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(kErfc[counter]));
+  // a^2 is split exactly into high + low, as the error in a rounded a^2 would
+  // be scaled by a^2 in the result. Then exp(-a^2) = exp(-high) * (1 - low).
+  __m256d high = _mm256_mul_pd(a, a);
+  __m256d low = _mm256_fmsub_pd(a, a, high);
+  __m256d scale = ExpAVX2(_mm256_sub_pd(_mm256_setzero_pd(), high));
+  scale = _mm256_fnmadd_pd(scale, low, scale);
+  return _mm256_mul_pd(scale, _mm256_div_pd(
+      p, _mm256_fmadd_pd(a, _mm256_set1_pd(2.0), _mm256_set1_pd(1.0))));
+}
+
+// Computes erf(x) for |x| < 0.75.
+__attribute__((target("avx2,fma")))
+inline __m256d ErfSmallAVX2(__m256d x) {
+  __m256d x2 = _mm256_mul_pd(x, x);
+  __m256d result = _mm256_set1_pd(kErf[15]);
+  for (int counter = 14; counter >= 0; counter--)
+    result = _mm256_fmadd_pd(result, x2, _mm256_set1_pd(kErf[counter]));
+  return _mm256_mul_pd(result, x);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d ErfAVX2(__m256d x) {
+  __m256d sign = _mm256_and_pd(x, _mm256_set1_pd(-0.0));
+  __m256d a = _mm256_xor_pd(x, sign);
+  // erf(a) = 1 - erfc(a) loses precision for small a, where the series is used.
+  __m256d small = _mm256_cmp_pd(a, _mm256_set1_pd(0.75), _CMP_LT_OQ);
+  __m256d result = _mm256_blendv_pd(
+      _mm256_sub_pd(_mm256_set1_pd(1.0), ErfcPositiveAVX2(a)),
+      ErfSmallAVX2(a), small);
+  return _mm256_or_pd(result, sign);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d ErfcAVX2(__m256d x) {
+  __m256d a = _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+  __m256d result = ErfcPositiveAVX2(a);
+  // erfc(x) = 2 - erfc(-x) for negative x.
+  __m256d negative = _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_LT_OQ);
+  return _mm256_blendv_pd(
+      result, _mm256_sub_pd(_mm256_set1_pd(2.0), result), negative);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d ErfInvAVX2(__m256d y) {
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d sign = _mm256_and_pd(y, _mm256_set1_pd(-0.0));
+  __m256d a = _mm256_xor_pd(y, sign);
+  // w = -log(1 - a^2), where 1 - a is exact for the a near 1 that matter.
+  __m256d w = _mm256_sub_pd(_mm256_setzero_pd(), LogAVX2(_mm256_mul_pd(
+      _mm256_sub_pd(one, a), _mm256_add_pd(one, a))));
+  __m256d central = _mm256_sub_pd(w, _mm256_set1_pd(3.125));
+  __m256d tail = _mm256_sub_pd(_mm256_sqrt_pd(w), _mm256_set1_pd(4.25));
+  __m256d central_p = _mm256_set1_pd(kErfInvCentral[9]);
+  __m256d tail_p = _mm256_set1_pd(kErfInvTail[9]);
+  for (int counter = 8; counter >= 0; counter--) {
+    central_p = _mm256_fmadd_pd(central_p, central,
+                                _mm256_set1_pd(kErfInvCentral[counter]));
+    tail_p = _mm256_fmadd_pd(tail_p, tail, _mm256_set1_pd(kErfInvTail[counter]));
+  }
+  __m256d is_central = _mm256_cmp_pd(w, _mm256_set1_pd(6.25), _CMP_LT_OQ);
+  __m256d x = _mm256_mul_pd(a, _mm256_blendv_pd(tail_p, central_p, is_central));
+  // A step of Halley's method on f(x) = erf(x) - a, for which f''(x) / f'(x) =
+  // -2x. For a >= 0.5, f is computed as (1 - a) - erfc(x) to avoid cancellation.
+  __m256d small = _mm256_cmp_pd(a, _mm256_set1_pd(0.5), _CMP_LT_OQ);
+  __m256d f = _mm256_blendv_pd(
+      _mm256_sub_pd(_mm256_sub_pd(one, a), ErfcPositiveAVX2(x)),
+      _mm256_sub_pd(ErfSmallAVX2(x), a), small);
+  // u = f(x) / f'(x), where f'(x) = 2 / sqrt(pi) * exp(-x^2).
+  __m256d u = _mm256_mul_pd(_mm256_mul_pd(f, _mm256_set1_pd(1 / M_2_SQRTPI)),
+                            ExpAVX2(_mm256_mul_pd(x, x)));
+  x = _mm256_sub_pd(x, _mm256_div_pd(u, _mm256_fmadd_pd(x, u, one)));
+  return _mm256_or_pd(x, sign);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d TanAVX2(__m256d x) {
+  // x = n * pi / 2 + r, where n is an integer and |r| <= pi / 4.
+  __m256d shifted = _mm256_fmadd_pd(x, _mm256_set1_pd(M_2_PI),
+                                    _mm256_set1_pd(kRoundMagic));
+  __m256d n = _mm256_sub_pd(shifted, _mm256_set1_pd(kRoundMagic));
+  __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(kPiOver2High), x);
+  r = _mm256_fnmadd_pd(n, _mm256_set1_pd(kPiOver2Mid), r);
+  r = _mm256_fnmadd_pd(n, _mm256_set1_pd(kPiOver2Low), r);
+  __m256d r2 = _mm256_mul_pd(r, r);
+  __m256d sin_r = _mm256_set1_pd(kSin[9]);
+  __m256d cos_r = _mm256_set1_pd(kCos[9]);
+  for (int counter = 8; counter >= 0; counter--) {
+    sin_r = _mm256_fmadd_pd(sin_r, r2, _mm256_set1_pd(kSin[counter]));
+    cos_r = _mm256_fmadd_pd(cos_r, r2, _mm256_set1_pd(kCos[counter]));
+  }
+  sin_r = _mm256_mul_pd(sin_r, r);
+  // tan(x) = tan(r) for even n and -1 / tan(r) for odd n. The low bit of
+  // n + kRoundMagic is that of n.
+  __m256d odd = _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+      _mm256_and_si256(_mm256_castpd_si256(shifted), _mm256_set1_epi64x(1)),
+      _mm256_set1_epi64x(1)));
+  __m256d numerator = _mm256_blendv_pd(
+      sin_r, _mm256_sub_pd(_mm256_setzero_pd(), cos_r), odd);
+  __m256d denominator = _mm256_blendv_pd(cos_r, sin_r, odd);
+  return _mm256_div_pd(numerator, denominator);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d AtanAVX2(__m256d x) {
+  __m256d sign = _mm256_and_pd(x, _mm256_set1_pd(-0.0));
+  __m256d a = _mm256_xor_pd(x, sign);
+  // atan(a) = j * pi / 8 + atan(r), where r = (a - c) / (1 + a * c) and
+  // c = tan(j * pi / 8), so that |r| <= tan(pi / 16). For j = 4, r = -1 / a.
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d j = _mm256_setzero_pd();
+  __m256d c = _mm256_setzero_pd();
+  const double tangents[3] = {kTanPiOver8, 1.0, kTan3PiOver8};
+  __m256d above;
+  for (int counter = 0; counter < 4; counter++) {
+    above = _mm256_cmp_pd(a, _mm256_set1_pd(kAtanBounds[counter]), _CMP_GT_OQ);
+    j = _mm256_add_pd(j, _mm256_and_pd(above, one));
+    if (counter < 3)
+      c = _mm256_blendv_pd(c, _mm256_set1_pd(tangents[counter]), above);
+  }
+  __m256d numerator = _mm256_blendv_pd(
+      _mm256_sub_pd(a, c), _mm256_set1_pd(-1.0), above);
+  __m256d denominator = _mm256_blendv_pd(_mm256_fmadd_pd(a, c, one), a, above);
+  __m256d r = _mm256_div_pd(numerator, denominator);
+  __m256d r2 = _mm256_mul_pd(r, r);
+  __m256d result = _mm256_set1_pd(kAtan[12]);
+  for (int counter = 11; counter >= 0; counter--)
+    result = _mm256_fmadd_pd(result, r2, _mm256_set1_pd(kAtan[counter]));
+  result = _mm256_fmadd_pd(j, _mm256_set1_pd(kPiOver8Low),
+                           _mm256_mul_pd(result, r));
+  result = _mm256_fmadd_pd(j, _mm256_set1_pd(kPiOver8High), result);
+  return _mm256_or_pd(result, sign);
+}
+
+// The scalar version of ErfInvAVX2, which is used for the remaining elements
+// and when AVX2 is not supported, as the standard library has no erf^-1.
+inline double ErfInvScalar(double y) {
+  double a = std::fabs(y);
+  double w = -std::log((1 - a) * (1 + a));
+  const double* coefficients = w < 6.25 ? kErfInvCentral : kErfInvTail;
+  double t = w < 6.25 ? w - 3.125 : std::sqrt(w) - 4.25;
+  double p = coefficients[9];
+  for (int counter = 8; counter >= 0; counter--)
+    p = p * t + coefficients[counter];
+  double x = a * p;
+  double f = a < 0.5 ? std::erf(x) - a : (1 - a) - std::erfc(x);
+  double u = f / M_2_SQRTPI * std::exp(x * x);
+  return std::copysign(x - u / (1 + x * u), y);
+}
+
+__attribute__((target("avx2,fma")))
+inline void ExpArrayAVX2(const double* in, double* out, std::size_t n) {
+  std::size_t counter = 0;
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, ExpAVX2(_mm256_loadu_pd(in + counter)));
+  for (; counter < n; counter++)
+    out[counter] = std::exp(in[counter]);
+}
+
+__attribute__((target("avx2,fma")))
+inline void LogArrayAVX2(const double* in, double* out, std::size_t n) {
+  std::size_t counter = 0;
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, LogAVX2(_mm256_loadu_pd(in + counter)));
+  for (; counter < n; counter++)
+    out[counter] = std::log(in[counter]);
+}
+
+__attribute__((target("avx2,fma")))
+inline void PowArrayAVX2(const double* in, double exponent, double* out,
+                         std::size_t n) {
+  std::size_t counter = 0;
+  __m256d power = _mm256_set1_pd(exponent);
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, ExpAVX2(_mm256_mul_pd(
+        power, LogAVX2(_mm256_loadu_pd(in + counter)))));
+  for (; counter < n; counter++)
+    out[counter] = std::pow(in[counter], exponent);
+}
+
+__attribute__((target("avx2,fma")))
+inline void ErfArrayAVX2(const double* in, double* out, std::size_t n) {
+  std::size_t counter = 0;
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, ErfAVX2(_mm256_loadu_pd(in + counter)));
+  for (; counter < n; counter++)
+    out[counter] = std::erf(in[counter]);
+}
+
+__attribute__((target("avx2,fma")))
+inline void ErfcArrayAVX2(const double* in, double* out, std::size_t n) {
+  std::size_t counter = 0;
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, ErfcAVX2(_mm256_loadu_pd(in + counter)));
+  for (; counter < n; counter++)
+    out[counter] = std::erfc(in[counter]);
+}
+
+__attribute__((target("avx2,fma")))
+inline void ErfInvArrayAVX2(const double* in, double* out, std::size_t n) {
+  std::size_t counter = 0;
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, ErfInvAVX2(_mm256_loadu_pd(in + counter)));
+  for (; counter < n; counter++)
+    out[counter] = ErfInvScalar(in[counter]);
+}
+
+__attribute__((target("avx2,fma")))
+inline void TanArrayAVX2(const double* in, double* out, std::size_t n) {
+  std::size_t counter = 0;
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, TanAVX2(_mm256_loadu_pd(in + counter)));
+  for (; counter < n; counter++)
+    out[counter] = std::tan(in[counter]);
+}
+
+__attribute__((target("avx2,fma")))
+inline void AtanArrayAVX2(const double* in, double* out, std::size_t n) {
+  std::size_t counter = 0;
+  for (; counter + 4 <= n; counter += 4)
+    _mm256_storeu_pd(out + counter, AtanAVX2(_mm256_loadu_pd(in + counter)));
+  for (; counter < n; counter++)
+    out[counter] = std::atan(in[counter]);
+}
+
+inline bool HasAVX2() {
+  static const bool has_avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  }();
+  return has_avx2;
+}
+
+}
+
+// out[i] = exp(in[i])
+inline void Exp(const double* in, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::ExpArrayAVX2(in, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = std::exp(in[counter]);
+  }
+}
+
+// out[i] = log(in[i])
+inline void Log(const double* in, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::LogArrayAVX2(in, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = std::log(in[counter]);
+  }
+}
+
+// out[i] = in[i] ^ exponent, for positive in[i].
+inline void Pow(const double* in, double exponent, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::PowArrayAVX2(in, exponent, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = std::pow(in[counter], exponent);
+  }
+}
+
+// out[i] = erf(in[i])
+inline void Erf(const double* in, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::ErfArrayAVX2(in, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = std::erf(in[counter]);
+  }
+}
+
+// out[i] = erfc(in[i])
+inline void Erfc(const double* in, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::ErfcArrayAVX2(in, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = std::erfc(in[counter]);
+  }
+}
+
+// out[i] = erf^-1(in[i]), for in[i] in (-1, 1).
+inline void ErfInv(const double* in, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::ErfInvArrayAVX2(in, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = internal::ErfInvScalar(in[counter]);
+  }
+}
+
+// out[i] = tan(in[i]), for |in[i]| <= 2^20.
+inline void Tan(const double* in, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::TanArrayAVX2(in, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = std::tan(in[counter]);
+  }
+}
+
+// out[i] = atan(in[i])
+inline void Atan(const double* in, double* out, std::size_t n) {
+  if (internal::HasAVX2()) {
+    internal::AtanArrayAVX2(in, out, n);
+  } else {
+    for (std::size_t counter = 0; counter < n; counter++)
+      out[counter] = std::atan(in[counter]);
+  }
+}
+
+}
+
+#endif // _VECTOR_MATH_H_